@@ -1,782 +1,6815 @@
-// lisp_interpreter.c
-// Oliver Skoczylas - CWID: 12281473
-// Implementation of LISP interpreter - Sprints 1-8
-
-#include "lisp_interpreter.h"
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <ctype.h>
-
-// ============================================================================
-// GLOBAL CONSTANTS DEFINITION
-// ============================================================================
-
-Sexp* NIL = NULL;
-Sexp* TRUE_SEXP = NULL;
-Sexp* GLOBAL_ENV = NULL;
-
-// ============================================================================
-// MEMORY MANAGEMENT
-// ============================================================================
-
-Sexp* allocate_sexp() {
-    Sexp* s = (Sexp*)malloc(sizeof(Sexp));
-    if (!s) {
-        fprintf(stderr, "Memory allocation failed\n");
-        exit(1);
-    }
-    return s;
-}
-
-// ============================================================================
-// SPRINT 1: CONSTRUCTORS
-// ============================================================================
-
-Sexp* nil() {
-    if (!NIL) {
-        NIL = allocate_sexp();
-        NIL->type = NIL_TYPE;
-    }
-    return NIL;
-}
-
-Sexp* make_number(double value) {
-    Sexp* s = allocate_sexp();
-    s->type = ATOM_NUMBER;
-    s->data.number = value;
-    return s;
-}
-
-Sexp* make_symbol(const char* value) {
-    Sexp* s = allocate_sexp();
-    s->type = ATOM_SYMBOL;
-    s->data.symbol = strdup(value);
-    return s;
-}
-
-Sexp* make_string(const char* value) {
-    Sexp* s = allocate_sexp();
-    s->type = ATOM_STRING;
-    s->data.string = strdup(value);
-    return s;
-}
-
-Sexp* cons(Sexp* car, Sexp* cdr) {
-    Sexp* s = allocate_sexp();
-    s->type = CONS_CELL;
-    s->data.cons.car = car;
-    s->data.cons.cdr = cdr;
-    return s;
-}
-
-Sexp* make_lambda(Sexp* params, Sexp* body, Sexp* env) {
-    Sexp* s = allocate_sexp();
-    s->type = LAMBDA_TYPE;
-    s->data.lambda.params = params;
-    s->data.lambda.body = body;
-    s->data.lambda.env = env;
-    return s;
-}
-
-Sexp* make_primitive(PrimitiveFunc func) {
-    Sexp* s = allocate_sexp();
-    s->type = PRIMITIVE_TYPE;
-    s->data.primitive = func;
-    return s;
-}
-
-// ============================================================================
-// SPRINT 2: PREDICATES
-// ============================================================================
-
-bool isNil(Sexp* s) {
-    return s == nil() || (s && s->type == NIL_TYPE);
-}
-
-bool isNumber(Sexp* s) {
-    return s && s->type == ATOM_NUMBER;
-}
-
-bool isSymbol(Sexp* s) {
-    return s && s->type == ATOM_SYMBOL;
-}
-
-bool isString(Sexp* s) {
-    return s && s->type == ATOM_STRING;
-}
-
-bool isList(Sexp* s) {
-    return isNil(s) || (s && s->type == CONS_CELL);
-}
-
-bool isTrueSexp(Sexp* s) {
-    return !isNil(s);
-}
-
-bool isLambda(Sexp* s) {
-    return s && s->type == LAMBDA_TYPE;
-}
-
-bool isPrimitive(Sexp* s) {
-    return s && s->type == PRIMITIVE_TYPE;
-}
-
-// ============================================================================
-// SPRINT 2: ACCESSORS
-// ============================================================================
-
-Sexp* car(Sexp* s) {
-    if (!s || s->type != CONS_CELL) {
-        fprintf(stderr, "Error: car called on non-cons cell\n");
-        return nil();
-    }
-    return s->data.cons.car;
-}
-
-Sexp* cdr(Sexp* s) {
-    if (!s || s->type != CONS_CELL) {
-        fprintf(stderr, "Error: cdr called on non-cons cell\n");
-        return nil();
-    }
-    return s->data.cons.cdr;
-}
-
-Sexp* cadr(Sexp* s) {
-    return car(cdr(s));
-}
-
-Sexp* caddr(Sexp* s) {
-    return car(cdr(cdr(s)));
-}
-
-Sexp* cadddr(Sexp* s) {
-    return car(cdr(cdr(cdr(s))));
-}
-
-// ============================================================================
-// SPRINT 2: ADDITIONAL FUNCTIONS
-// ============================================================================
-
-bool eq(Sexp* a, Sexp* b) {
-    if (isNil(a) && isNil(b)) return true;
-    if (isNil(a) || isNil(b)) return false;
-    if (a->type != b->type) return false;
-    
-    switch (a->type) {
-        case ATOM_NUMBER:
-            return a->data.number == b->data.number;
-        case ATOM_SYMBOL:
-            return strcmp(a->data.symbol, b->data.symbol) == 0;
-        case ATOM_STRING:
-            return strcmp(a->data.string, b->data.string) == 0;
-        case CONS_CELL:
-            return a == b;
-        default:
-            return false;
-    }
-}
-
-bool null(Sexp* s) {
-    return isNil(s);
-}
-
-// ============================================================================
-// SPRINT 3: ARITHMETIC FUNCTIONS
-// ============================================================================
-
-Sexp* add(Sexp* a, Sexp* b) {
-    if (!isNumber(a) || !isNumber(b)) {
-        return make_symbol("ERROR:NOT_A_NUMBER");
-    }
-    return make_number(a->data.number + b->data.number);
-}
-
-Sexp* sub(Sexp* a, Sexp* b) {
-    if (!isNumber(a) || !isNumber(b)) {
-        return make_symbol("ERROR:NOT_A_NUMBER");
-    }
-    return make_number(a->data.number - b->data.number);
-}
-
-Sexp* mul(Sexp* a, Sexp* b) {
-    if (!isNumber(a) || !isNumber(b)) {
-        return make_symbol("ERROR:NOT_A_NUMBER");
-    }
-    return make_number(a->data.number * b->data.number);
-}
-
-Sexp* divide(Sexp* a, Sexp* b) {
-    if (!isNumber(a) || !isNumber(b)) {
-        return make_symbol("ERROR:NOT_A_NUMBER");
-    }
-    if (b->data.number == 0) {
-        return make_symbol("ERROR:DIVISION_BY_ZERO");
-    }
-    return make_number(a->data.number / b->data.number);
-}
-
-Sexp* mod(Sexp* a, Sexp* b) {
-    if (!isNumber(a) || !isNumber(b)) {
-        return make_symbol("ERROR:NOT_A_NUMBER");
-    }
-    if (b->data.number == 0) {
-        return make_symbol("ERROR:DIVISION_BY_ZERO");
-    }
-    return make_number((int)a->data.number % (int)b->data.number);
-}
-
-// ============================================================================
-// SPRINT 3: COMPARISON FUNCTIONS
-// ============================================================================
-
-Sexp* lt(Sexp* a, Sexp* b) {
-    if (!isNumber(a) || !isNumber(b)) {
-        return make_symbol("ERROR:NOT_A_NUMBER");
-    }
-    return (a->data.number < b->data.number) ? make_symbol("T") : nil();
-}
-
-Sexp* gt(Sexp* a, Sexp* b) {
-    if (!isNumber(a) || !isNumber(b)) {
-        return make_symbol("ERROR:NOT_A_NUMBER");
-    }
-    return (a->data.number > b->data.number) ? make_symbol("T") : nil();
-}
-
-Sexp* lte(Sexp* a, Sexp* b) {
-    if (!isNumber(a) || !isNumber(b)) {
-        return make_symbol("ERROR:NOT_A_NUMBER");
-    }
-    return (a->data.number <= b->data.number) ? make_symbol("T") : nil();
-}
-
-Sexp* gte(Sexp* a, Sexp* b) {
-    if (!isNumber(a) || !isNumber(b)) {
-        return make_symbol("ERROR:NOT_A_NUMBER");
-    }
-    return (a->data.number >= b->data.number) ? make_symbol("T") : nil();
-}
-
-Sexp* not(Sexp* s) {
-    return isNil(s) ? make_symbol("T") : nil();
-}
-
-// ============================================================================
-// SPRINT 5: ENVIRONMENT MANAGEMENT
-// ============================================================================
-
-Sexp* make_env(Sexp* symbols, Sexp* values, Sexp* parent) {
-    return cons(cons(symbols, values), parent);
-}
-
-Sexp* env_symbols(Sexp* env) {
-    if (isNil(env)) return nil();
-    return car(car(env));
-}
-
-Sexp* env_values(Sexp* env) {
-    if (isNil(env)) return nil();
-    return cdr(car(env));
-}
-
-Sexp* env_parent(Sexp* env) {
-    if (isNil(env)) return nil();
-    return cdr(env);
-}
-
-Sexp* env_set(Sexp* env, Sexp* symbol, Sexp* value) {
-    Sexp* symbols = env_symbols(env);
-    Sexp* values = env_values(env);
-    
-    // Add to the front of both lists
-    Sexp* new_symbols = cons(symbol, symbols);
-    Sexp* new_values = cons(value, values);
-    
-    // Update the environment
-    env->data.cons.car = cons(new_symbols, new_values);
-    return value;
-}
-
-Sexp* env_lookup(Sexp* env, Sexp* symbol) {
-    while (!isNil(env)) {
-        Sexp* symbols = env_symbols(env);
-        Sexp* values = env_values(env);
-        
-        while (!isNil(symbols)) {
-            if (isSymbol(car(symbols)) && isSymbol(symbol)) {
-                if (strcmp(car(symbols)->data.symbol, symbol->data.symbol) == 0) {
-                    return car(values);
-                }
-            }
-            symbols = cdr(symbols);
-            values = cdr(values);
-        }
-        env = env_parent(env);
-    }
-    
-    // Symbol not found - return undefined message
-    return make_symbol("UNDEFINED");
-}
-
-// Primitive function wrappers for eval
-Sexp* prim_add(Sexp* args, Sexp* env) {
-    (void)env;
-    return add(car(args), cadr(args));
-}
-
-Sexp* prim_sub(Sexp* args, Sexp* env) {
-    (void)env;
-    return sub(car(args), cadr(args));
-}
-
-Sexp* prim_mul(Sexp* args, Sexp* env) {
-    (void)env;
-    return mul(car(args), cadr(args));
-}
-
-Sexp* prim_div(Sexp* args, Sexp* env) {
-    (void)env;
-    return divide(car(args), cadr(args));
-}
-
-Sexp* prim_mod(Sexp* args, Sexp* env) {
-    (void)env;
-    return mod(car(args), cadr(args));
-}
-
-Sexp* prim_lt(Sexp* args, Sexp* env) {
-    (void)env;
-    return lt(car(args), cadr(args));
-}
-
-Sexp* prim_gt(Sexp* args, Sexp* env) {
-    (void)env;
-    return gt(car(args), cadr(args));
-}
-
-Sexp* prim_lte(Sexp* args, Sexp* env) {
-    (void)env;
-    return lte(car(args), cadr(args));
-}
-
-Sexp* prim_gte(Sexp* args, Sexp* env) {
-    (void)env;
-    return gte(car(args), cadr(args));
-}
-
-Sexp* prim_eq(Sexp* args, Sexp* env) {
-    (void)env;
-    return eq(car(args), cadr(args)) ? make_symbol("T") : nil();
-}
-
-Sexp* prim_not(Sexp* args, Sexp* env) {
-    (void)env;
-    return not(car(args));
-}
-
-Sexp* prim_cons(Sexp* args, Sexp* env) {
-    (void)env;
-    return cons(car(args), cadr(args));
-}
-
-Sexp* prim_car(Sexp* args, Sexp* env) {
-    (void)env;
-    return car(car(args));
-}
-
-Sexp* prim_cdr(Sexp* args, Sexp* env) {
-    (void)env;
-    return cdr(car(args));
-}
-
-void init_global_env() {
-    GLOBAL_ENV = make_env(nil(), nil(), nil());
-    
-    // Add primitive functions
-    env_set(GLOBAL_ENV, make_symbol("+"), make_primitive(prim_add));
-    env_set(GLOBAL_ENV, make_symbol("-"), make_primitive(prim_sub));
-    env_set(GLOBAL_ENV, make_symbol("*"), make_primitive(prim_mul));
-    env_set(GLOBAL_ENV, make_symbol("/"), make_primitive(prim_div));
-    env_set(GLOBAL_ENV, make_symbol("%"), make_primitive(prim_mod));
-    env_set(GLOBAL_ENV, make_symbol("<"), make_primitive(prim_lt));
-    env_set(GLOBAL_ENV, make_symbol(">"), make_primitive(prim_gt));
-    env_set(GLOBAL_ENV, make_symbol("<="), make_primitive(prim_lte));
-    env_set(GLOBAL_ENV, make_symbol(">="), make_primitive(prim_gte));
-    env_set(GLOBAL_ENV, make_symbol("eq"), make_primitive(prim_eq));
-    env_set(GLOBAL_ENV, make_symbol("not"), make_primitive(prim_not));
-    env_set(GLOBAL_ENV, make_symbol("cons"), make_primitive(prim_cons));
-    env_set(GLOBAL_ENV, make_symbol("car"), make_primitive(prim_car));
-    env_set(GLOBAL_ENV, make_symbol("cdr"), make_primitive(prim_cdr));
-    
-    // Alternative names
-    env_set(GLOBAL_ENV, make_symbol("add"), make_primitive(prim_add));
-    env_set(GLOBAL_ENV, make_symbol("sub"), make_primitive(prim_sub));
-    env_set(GLOBAL_ENV, make_symbol("mul"), make_primitive(prim_mul));
-    env_set(GLOBAL_ENV, make_symbol("div"), make_primitive(prim_div));
-    env_set(GLOBAL_ENV, make_symbol("mod"), make_primitive(prim_mod));
-}
-
-// ============================================================================
-// SPRINT 5-8: EVAL FUNCTION
-// ============================================================================
-
-Sexp* eval_list(Sexp* list, Sexp* env) {
-    if (isNil(list)) return nil();
-    return cons(eval(car(list), env), eval_list(cdr(list), env));
-}
-
-Sexp* apply(Sexp* func, Sexp* args, Sexp* env) {
-    if (isPrimitive(func)) {
-        return func->data.primitive(args, env);
-    } else if (isLambda(func)) {
-        // Create new environment with parameters bound to arguments
-        Sexp* new_env = make_env(func->data.lambda.params, args, func->data.lambda.env);
-        return eval(func->data.lambda.body, new_env);
-    }
-    return make_symbol("ERROR:NOT_A_FUNCTION");
-}
-
-Sexp* eval(Sexp* sexp, Sexp* env) {
-    // Handle nil
-    if (isNil(sexp)) {
-        return nil();
-    }
-    
-    // Handle numbers and strings - self-evaluating
-    if (isNumber(sexp) || isString(sexp)) {
-        return sexp;
-    }
-    
-    // Handle symbols - look up in environment
-    if (isSymbol(sexp)) {
-        return env_lookup(env, sexp);
-    }
-    
-    // Handle lists - function calls and special forms
-    if (isList(sexp)) {
-        Sexp* first = car(sexp);
-        
-        // Special forms
-        if (isSymbol(first)) {
-            char* sym = first->data.symbol;
-            
-            // QUOTE
-            if (strcmp(sym, "quote") == 0) {
-                return cadr(sexp);
-            }
-            
-            // SET
-            if (strcmp(sym, "set") == 0) {
-                Sexp* symbol = cadr(sexp);
-                Sexp* value = eval(caddr(sexp), env);
-                return env_set(env, symbol, value);
-            }
-            
-            // DEFINE (Sprint 7)
-            if (strcmp(sym, "define") == 0) {
-                Sexp* name = cadr(sexp);
-                Sexp* params = caddr(sexp);
-                Sexp* body = cadddr(sexp);
-                Sexp* lambda = make_lambda(params, body, env);
-                return env_set(env, name, lambda);
-            }
-            
-            // LAMBDA (Sprint 8)
-            if (strcmp(sym, "lambda") == 0) {
-                Sexp* params = cadr(sexp);
-                Sexp* body = caddr(sexp);
-                return make_lambda(params, body, env);
-            }
-            
-            // IF (Sprint 6)
-            if (strcmp(sym, "if") == 0) {
-                Sexp* test = eval(cadr(sexp), env);
-                if (isTrueSexp(test)) {
-                    return eval(caddr(sexp), env);
-                } else {
-                    return eval(cadddr(sexp), env);
-                }
-            }
-            
-            // AND (Sprint 6)
-            if (strcmp(sym, "and") == 0) {
-                Sexp* e1 = eval(cadr(sexp), env);
-                if (isNil(e1)) {
-                    return nil();
-                }
-                return eval(caddr(sexp), env);
-            }
-            
-            // OR (Sprint 6)
-            if (strcmp(sym, "or") == 0) {
-                Sexp* e1 = eval(cadr(sexp), env);
-                if (!isNil(e1)) {
-                    return make_symbol("T");
-                }
-                return eval(caddr(sexp), env);
-            }
-            
-            // COND (Sprint 6)
-            if (strcmp(sym, "cond") == 0) {
-                Sexp* clauses = cdr(sexp);
-                while (!isNil(clauses)) {
-                    Sexp* clause = car(clauses);
-                    Sexp* test = eval(car(clause), env);
-                    if (isTrueSexp(test)) {
-                        return eval(cadr(clause), env);
-                    }
-                    clauses = cdr(clauses);
-                }
-                return nil();  // No clause matched
-            }
-        }
-        
-        // Regular function call - evaluate function and arguments
-        Sexp* func = eval(first, env);
-        Sexp* args = eval_list(cdr(sexp), env);
-        return apply(func, args, env);
-    }
-    
-    return sexp;
-}
-
-// ============================================================================
-// HELPER FUNCTIONS
-// ============================================================================
-
-Sexp* atom(const char* str) {
-    // Check if it's a number
-    char* endptr;
-    double val = strtod(str, &endptr);
-    if (*endptr == '\0' && str[0] != '\0') {
-        return make_number(val);
-    }
-    
-    // Check if it's a string (starts and ends with quotes)
-    if (str[0] == '"' && str[strlen(str)-1] == '"') {
-        char* content = strdup(str + 1);
-        content[strlen(content)-1] = '\0';
-        Sexp* s = make_string(content);
-        free(content);
-        return s;
-    }
-    
-    // Otherwise it's a symbol
-    return make_symbol(str);
-}
-
-Sexp* list() {
-    return nil();
-}
-
-Sexp* list1(Sexp* a) {
-    return cons(a, nil());
-}
-
-Sexp* list2(Sexp* a, Sexp* b) {
-    return cons(a, cons(b, nil()));
-}
-
-Sexp* list3(Sexp* a, Sexp* b, Sexp* c) {
-    return cons(a, cons(b, cons(c, nil())));
-}
-
-Sexp* list4(Sexp* a, Sexp* b, Sexp* c, Sexp* d) {
-    return cons(a, cons(b, cons(c, cons(d, nil()))));
-}
-
-Sexp* append(Sexp* list1, Sexp* list2) {
-    if (isNil(list1)) return list2;
-    return cons(car(list1), append(cdr(list1), list2));
-}
-
-int length(Sexp* list) {
-    int len = 0;
-    while (!isNil(list)) {
-        len++;
-        list = cdr(list);
-    }
-    return len;
-}
-
-// ============================================================================
-// SIMPLE PARSER
-// ============================================================================
-
-void skip_whitespace(const char** input) {
-    while (**input && isspace(**input)) {
-        (*input)++;
-    }
-}
-
-Sexp* read_atom(const char** input) {
-    char buffer[256];
-    int i = 0;
-    
-    // Handle strings
-    if (**input == '"') {
-        buffer[i++] = *(*input)++;
-        while (**input && **input != '"' && i < 255) {
-            buffer[i++] = *(*input)++;
-        }
-        if (**input == '"') {
-            buffer[i++] = *(*input)++;
-        }
-        buffer[i] = '\0';
-        return atom(buffer);
-    }
-    
-    // Handle symbols and numbers
-    while (**input && !isspace(**input) && **input != '(' && **input != ')' && i < 255) {
-        buffer[i++] = *(*input)++;
-    }
-    buffer[i] = '\0';
-    
-    if (i == 0) return nil();
-    return atom(buffer);
-}
-
-Sexp* read_list(const char** input);
-
-Sexp* read_sexp(const char** input) {
-    skip_whitespace(input);
-    
-    if (**input == '\0') {
-        return nil();
-    }
-    
-    if (**input == '(') {
-        return read_list(input);
-    }
-    
-    if (**input == '\'') {
-        (*input)++;  // Skip quote
-        return list2(make_symbol("quote"), read_sexp(input));
-    }
-    
-    return read_atom(input);
-}
-
-Sexp* read_list(const char** input) {
-    (*input)++;  // Skip opening paren
-    skip_whitespace(input);
-    
-    if (**input == ')') {
-        (*input)++;  // Skip closing paren
-        return nil();
-    }
-    
-    // Build list iteratively to avoid recursion bug
-    Sexp* head = nil();
-    Sexp* tail = nil();
-    
-    while (**input != ')' && **input != '\0') {
-        Sexp* elem = read_sexp(input);
-        skip_whitespace(input);
-        
-        // Check for dotted pair
-        if (**input == '.' && (*(*input + 1) == ' ' || *(*input + 1) == ')' || isspace(*(*input + 1)))) {
-            (*input)++;  // Skip dot
-            skip_whitespace(input);
-            Sexp* rest = read_sexp(input);
-            skip_whitespace(input);
-            if (**input == ')') {
-                (*input)++;
-            }
-            
-            // Handle dotted pair
-            if (isNil(head)) {
-                return cons(elem, rest);
-            } else {
-                tail->data.cons.cdr = cons(elem, rest);
-                return head;
-            }
-        }
-        
-        // Add element to list
-        if (isNil(head)) {
-            head = tail = cons(elem, nil());
-        } else {
-            tail->data.cons.cdr = cons(elem, nil());
-            tail = tail->data.cons.cdr;
-        }
-        
-        skip_whitespace(input);
-    }
-    
-    if (**input == ')') {
-        (*input)++;  // Skip closing paren
-    }
-    
-    return head;
-}
-
-Sexp* parse(const char* input) {
-    return read_sexp(&input);
-}
-
-// ============================================================================
-// PRINTING FUNCTIONS
-// ============================================================================
-
-void print_sexp(Sexp* s) {
-    if (isNil(s)) {
-        printf("()");
-        return;
-    }
-    
-    switch (s->type) {
-        case ATOM_NUMBER:
-            if (s->data.number == (int)s->data.number) {
-                printf("%d", (int)s->data.number);
-            } else {
-                printf("%g", s->data.number);
-            }
-            break;
-            
-        case ATOM_SYMBOL:
-            printf("%s", s->data.symbol);
-            break;
-            
-        case ATOM_STRING:
-            printf("\"%s\"", s->data.string);
-            break;
-            
-        case LAMBDA_TYPE:
-            printf("#<lambda>");
-            break;
-            
-        case PRIMITIVE_TYPE:
-            printf("#<primitive>");
-            break;
-            
-        case CONS_CELL:
-            printf("(");
-            Sexp* current = s;
-            while (current && current->type == CONS_CELL) {
-                print_sexp(current->data.cons.car);
-                current = current->data.cons.cdr;
-                if (current && !isNil(current)) {
-                    if (current->type == CONS_CELL) {
-                        printf(" ");
-                    } else {
-                        // Dotted pair
-                        printf(" . ");
-                        print_sexp(current);
-                        break;
-                    }
-                }
-            }
-            printf(")");
-            break;
-            
-        default:
-            break;
-    }
-}
-
-void println_sexp(Sexp* s) {
-    print_sexp(s);
-    printf("\n");
-}
\ No newline at end of file
+// lisp_interpreter.c
+// Oliver Skoczylas - CWID: 12281473
+// Implementation of LISP interpreter - Sprints 1-8
+
+#define _GNU_SOURCE     // pthread_getattr_np, for each thread's stack bounds
+
+#include "lisp_interpreter.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <math.h>
+#include <setjmp.h>
+#include <unistd.h>
+
+// Native code for hot numeric lambdas needs an x86-64 target that can map
+// executable pages (see JIT); -DLISP_NO_JIT leaves it out
+#if defined(__x86_64__) && defined(__linux__) && !defined(LISP_NO_JIT)
+#define LISP_JIT 1
+#include <sys/mman.h>
+#endif
+
+// ============================================================================
+// MEMORY MANAGEMENT
+// ============================================================================
+
+// Memory comes from 64KB slab pages, each aligned to its own size so the
+// page header of any object is found by masking the pointer. A page holds
+// slots of one size class: 16-byte cons cells, Sexp cells for every other
+// type, or one of the byte classes used for symbol and string text. New
+// pages are carved by bumping a pointer, so lists built front to back get
+// contiguous spines; slots freed later are reused through per-class free
+// lists kept in address order. Cons cells have no header, so their mark
+// bits live in a bitmap after the page header.
+//
+// Cells are reclaimed by a mark-and-sweep collector. Marking is precise for
+// the heap itself. Values held in C locals (eval's temporaries, parser
+// state, embedder code) are found by scanning the C stack conservatively:
+// any word that points into a live cell keeps it. A page left with no
+// marked cells is released whole, so short-lived garbage never needs to be
+// freed cell by cell.
+
+#define SLAB_PAGE_SIZE    65536
+#define SLAB_HEADER_SIZE  64
+#define SLAB_BYTE_CLASSES 5          // 16, 32, 64, 128 and 256 bytes
+#define SLAB_CELL_CLASS   SLAB_BYTE_CLASSES
+#define SLAB_CONS_CLASS   (SLAB_BYTE_CLASSES + 1)
+#define CONS_MARK_WORDS   ((SLAB_PAGE_SIZE / sizeof(ConsCell) + 63) / 64)
+#define SLAB_SPARE_PAGES  4          // empty pages kept for reuse
+
+typedef struct SlabPage {
+    struct SlabPage* next;           // next page of the same class
+    size_t slot_size;
+    size_t slot_count;
+    size_t used;                     // slots handed out so far by bumping
+    size_t marked;                   // cells marked by the current collection
+    size_t owners;                   // cells owning a symbol/string buffer
+    char* slots;                     // first slot, after the header
+    int size_class;
+} SlabPage;
+
+// The header must fit in front of the slots
+typedef char slab_header_fits[sizeof(SlabPage) <= SLAB_HEADER_SIZE ? 1 : -1];
+
+struct ArenaChunk {
+    struct ArenaChunk* next;
+    size_t size;
+    size_t used;
+};
+
+// Everything one interpreter owns (see INTERPRETER CONTEXTS). The code
+// reaches it through interp, the current thread's Interp.
+struct Interp {
+    SlabPage* cell_pages;
+    SlabPage* cell_bump_page;
+    Sexp* free_list;
+    SlabPage* cons_pages;
+    SlabPage* cons_bump_page;
+    ConsCell* cons_free_list;
+    SlabPage* byte_pages[SLAB_BYTE_CLASSES];
+    void* byte_free[SLAB_BYTE_CLASSES];
+    SlabPage* spare_pages;
+    size_t spare_page_count;
+
+    // Sorted by address so conservative stack scanning can binary search
+    SlabPage** page_table;
+    size_t page_count;
+    size_t page_capacity;
+
+    size_t heap_cells;
+    size_t cells_in_use;
+    size_t heap_initial_cells;
+    size_t heap_max_cells;
+    size_t heap_threshold;
+
+    Sexp*** gc_roots;
+    size_t gc_root_count;
+    size_t gc_root_capacity;
+
+    Sexp** mark_stack;
+    size_t mark_top;
+    size_t mark_capacity;
+
+    struct ArenaChunk* scratch_chunks;
+    struct FrameChunk* frame_chunks;       // See FRAME STACK
+    struct FrameChunk* spare_frame_chunk;
+
+    // Interned symbols are roots too (see SYMBOL TABLE)
+    Sexp** symbol_table;
+    size_t symbol_capacity;
+    size_t symbol_count;
+
+    Sexp* nil;               // Boxed builds only; immediates otherwise
+    Sexp* true_value;
+    Sexp* global_env;
+    size_t global_version;   // See ENVIRONMENT MANAGEMENT
+    Sexp* global_snapshot;   // See PARALLEL EVALUATION
+    struct Pack* global_pack;
+    Sexp* resolve_env;       // See LEXICAL ADDRESSING
+
+    // eval's argument and continuation stacks (see EVAL FUNCTION)
+    Sexp** arg_stack;
+    size_t arg_top;
+    size_t arg_capacity;
+    struct Cont* cont_stack;
+    size_t cont_top;
+    size_t cont_capacity;
+    size_t eval_max_depth;
+    int eval_nesting;
+    bool stack_overflowed;
+    bool heap_exhausted;
+
+    Engine current_engine;
+    struct VMFrame* vm_frames;
+    size_t vm_frame_count;
+    size_t vm_frame_capacity;
+
+    uintptr_t node_stack_floor;  // See CLOSURE COMPILER
+    int node_runs;
+    size_t node_depth;
+    size_t tail_base;
+    size_t jit_threshold;
+
+    struct ReadFrame* read_stack;    // See SIMPLE PARSER
+    size_t read_top;
+    size_t read_capacity;
+    struct PrintItem* print_stack;   // See PRINTING FUNCTIONS
+    size_t print_top;
+    size_t print_capacity;
+};
+
+#define INTERP_DEFAULTS {                          \
+    .heap_initial_cells = GC_DEFAULT_HEAP_CELLS,   \
+    .heap_max_cells = GC_DEFAULT_MAX_CELLS,        \
+    .heap_threshold = GC_DEFAULT_HEAP_CELLS,       \
+    .global_version = 1,                           \
+    .eval_max_depth = EVAL_DEFAULT_MAX_DEPTH,      \
+    .current_engine = ENGINE_EVAL,                 \
+    .jit_threshold = JIT_DEFAULT_THRESHOLD,        \
+}
+
+// The interpreter a thread runs on until it enters another one; programs
+// that never make an Interp use only this
+static Interp default_interp = INTERP_DEFAULTS;
+static _Thread_local Interp* interp = &default_interp;
+
+static inline Interp* current_interp(void) {
+    return interp;
+}
+
+// Hot loops start with this: it shadows the thread-local with a local the
+// compiler can keep in a register, which their interp-> accesses then use
+#define LOCAL_INTERP Interp* const interp = current_interp()
+
+// A fresh Interp with the settings of from
+static void interp_init(Interp* ctx, const Interp* from) {
+    *ctx = (Interp)INTERP_DEFAULTS;
+    ctx->heap_initial_cells = from->heap_initial_cells;
+    ctx->heap_max_cells = from->heap_max_cells;
+    ctx->heap_threshold = from->heap_initial_cells;
+    ctx->eval_max_depth = from->eval_max_depth;
+    ctx->current_engine = from->current_engine;
+    ctx->jit_threshold = from->jit_threshold;
+}
+
+#undef NIL
+#undef TRUE_SEXP
+#undef GLOBAL_ENV
+#ifdef LISP_NAN_BOXING
+#define NIL                ((Sexp*)SEXP_NIL_BITS)
+#define TRUE_SEXP          ((Sexp*)SEXP_TRUE_BITS)
+#else
+#define NIL                (interp->nil)
+#define TRUE_SEXP          (interp->true_value)
+#endif
+#define GLOBAL_ENV         (interp->global_env)
+
+// Global environment tables (see ENVIRONMENT MANAGEMENT)
+typedef struct EnvTable EnvTable;
+static void gc_mark_env_table(Sexp* env);
+static void free_table_env(Sexp* env);
+
+// Lambda template layout and compiled code (see LEXICAL ADDRESSING and
+// BYTECODE VM)
+typedef struct ProtoInfo {
+    int arity;
+    int nslots;              // Params followed by locals made by set/define
+    int* code;               // Bytecode, NULL until the VM first runs it
+    int code_length;
+    int code_capacity;
+    Sexp** consts;           // Constants and names the bytecode refers to
+    int const_count;
+    int const_capacity;
+    int max_stack;           // Deepest the body's temporaries get
+    bool stack_frames;       // No closure can capture a frame (see FRAME STACK)
+    struct Node* tree;       // Analyzed body, NULL until the closure compiler first runs it
+    struct Node* nodes;      // Every node of tree, for freeing
+    size_t calls;            // Calls counted toward the JIT threshold
+    struct JitCode* jit[2];  // Native code for integer and double arguments
+} ProtoInfo;
+static void free_proto_info(Sexp* proto);
+static void future_release(struct Task* task);
+static void pack_release(struct Pack* pack);
+static void gc_mark_jit(ProtoInfo* info);
+static void gc_mark_frame_stack(void);
+static void gc_mark_arg_stack(void);
+static void gc_mark_eval_stack(void);
+static void gc_mark_reader(void);
+static void gc_mark_vm(void);
+
+// Held in the car of a cons cell sitting on the free list
+static char free_cons_marker;
+#define CONS_FREE ((Sexp*)&free_cons_marker)
+
+#if defined(__GLIBC__)
+extern void* __libc_stack_end;
+#endif
+
+static void out_of_memory(void) {
+    fprintf(stderr, "Memory allocation failed\n");
+    exit(1);
+}
+
+// The high end of the calling thread's stack, where the collector's stack
+// scan stops. Kept per thread rather than per Interp: an Interp may be
+// used from several threads in turn, and each scans its own stack.
+static void* thread_stack_bottom(void) {
+    static _Thread_local void* bottom = NULL;
+    if (bottom) return bottom;
+#if defined(__GLIBC__)
+    pthread_attr_t attr;
+    if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+        void* stack;
+        size_t size;
+        if (pthread_attr_getstack(&attr, &stack, &size) == 0) {
+            bottom = (char*)stack + size;
+        }
+        pthread_attr_destroy(&attr);
+    }
+    if (!bottom) bottom = __libc_stack_end;
+#else
+    // Without a libc hook, use the frame of the first call into the heap.
+    // Embedders should then allocate (e.g. call nil()) from main(), or
+    // from the thread's start function.
+    bottom = __builtin_frame_address(0);
+#endif
+    return bottom;
+}
+
+static void gc_find_stack_bottom(void) {
+    thread_stack_bottom();
+}
+
+static SlabPage* page_of(const void* p) {
+    return (SlabPage*)((size_t)p & ~(size_t)(SLAB_PAGE_SIZE - 1));
+}
+
+static char* page_slots(SlabPage* page) {
+    return page->slots;
+}
+
+// Cons pages keep one mark bit per cell between the header and the slots
+static uint64_t* cons_mark_bits(SlabPage* page) {
+    return (uint64_t*)((char*)page + SLAB_HEADER_SIZE);
+}
+
+// Return the registered page containing p, or NULL if p is not heap memory
+static SlabPage* page_lookup(const void* p) {
+    SlabPage* page = page_of(p);
+    size_t lo = 0;
+    size_t hi = interp->page_count;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (interp->page_table[mid] == page) return page;
+        if (interp->page_table[mid] < page) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return NULL;
+}
+
+static SlabPage* page_new(int size_class, size_t slot_size) {
+    SlabPage* page = NULL;
+
+    if (interp->spare_pages) {
+        page = interp->spare_pages;
+        interp->spare_pages = page->next;
+        interp->spare_page_count--;
+    } else {
+        void* mem = NULL;
+#if defined(_WIN32)
+        mem = _aligned_malloc(SLAB_PAGE_SIZE, SLAB_PAGE_SIZE);
+#else
+        if (posix_memalign(&mem, SLAB_PAGE_SIZE, SLAB_PAGE_SIZE) != 0) mem = NULL;
+#endif
+        if (!mem) out_of_memory();
+        page = (SlabPage*)mem;
+    }
+
+    if (interp->page_count == interp->page_capacity) {
+        size_t capacity = interp->page_capacity ? interp->page_capacity * 2 : 64;
+        SlabPage** grown = (SlabPage**)realloc(interp->page_table, capacity * sizeof(SlabPage*));
+        if (!grown) out_of_memory();
+        interp->page_table = grown;
+        interp->page_capacity = capacity;
+    }
+    size_t i = interp->page_count;
+    while (i > 0 && interp->page_table[i - 1] > page) {
+        interp->page_table[i] = interp->page_table[i - 1];
+        i--;
+    }
+    interp->page_table[i] = page;
+    interp->page_count++;
+
+    size_t header_size = SLAB_HEADER_SIZE;
+    if (size_class == SLAB_CONS_CLASS) {
+        memset(cons_mark_bits(page), 0, CONS_MARK_WORDS * sizeof(uint64_t));
+        header_size += CONS_MARK_WORDS * sizeof(uint64_t);
+    }
+
+    page->next = NULL;
+    page->slots = (char*)page + header_size;
+    page->slot_size = slot_size;
+    page->slot_count = (SLAB_PAGE_SIZE - header_size) / slot_size;
+    page->used = 0;
+    page->marked = 0;
+    page->owners = 0;
+    page->size_class = size_class;
+    return page;
+}
+
+static void page_destroy(SlabPage* page) {
+#if defined(_WIN32)
+    _aligned_free(page);
+#else
+    free(page);
+#endif
+}
+
+static void page_release(SlabPage* page) {
+    size_t i = 0;
+    while (i < interp->page_count && interp->page_table[i] != page) i++;
+    for (; i + 1 < interp->page_count; i++) {
+        interp->page_table[i] = interp->page_table[i + 1];
+    }
+    interp->page_count--;
+
+    if (interp->spare_page_count < SLAB_SPARE_PAGES) {
+        page->next = interp->spare_pages;
+        interp->spare_pages = page;
+        interp->spare_page_count++;
+    } else {
+        page_destroy(page);
+    }
+}
+
+// Allocate a buffer owned by a heap cell (symbol text, frame slots) from
+// the byte slab of the smallest class that fits
+static void* heap_alloc_bytes(size_t size) {
+    int size_class = 0;
+    size_t slot_size = 16;
+    while (slot_size < size && size_class < SLAB_BYTE_CLASSES) {
+        slot_size *= 2;
+        size_class++;
+    }
+
+    void* p;
+    if (size_class == SLAB_BYTE_CLASSES) {
+        p = malloc(size);
+        if (!p) out_of_memory();
+    } else if (interp->byte_free[size_class]) {
+        p = interp->byte_free[size_class];
+        interp->byte_free[size_class] = *(void**)p;
+    } else {
+        SlabPage* page = interp->byte_pages[size_class];
+        if (!page || page->used == page->slot_count) {
+            page = page_new(size_class, slot_size);
+            page->next = interp->byte_pages[size_class];
+            interp->byte_pages[size_class] = page;
+        }
+        p = page_slots(page) + page->used * slot_size;
+        page->used++;
+    }
+    return p;
+}
+
+static void heap_free_bytes(void* p) {
+    SlabPage* page = page_lookup(p);
+    if (!page) {
+        free(p);
+        return;
+    }
+    *(void**)p = interp->byte_free[page->size_class];
+    interp->byte_free[page->size_class] = p;
+}
+
+// Copy a symbol or string into slab storage sized to the text
+static char* heap_strdup(const char* text) {
+    size_t len = strlen(text) + 1;
+    char* copy = (char*)heap_alloc_bytes(len);
+    memcpy(copy, text, len);
+    return copy;
+}
+
+void gc_configure(size_t initial_cells, size_t max_cells) {
+    interp->heap_initial_cells = initial_cells ? initial_cells : GC_DEFAULT_HEAP_CELLS;
+    interp->heap_max_cells = max_cells;
+    if (interp->heap_threshold < interp->heap_initial_cells) {
+        interp->heap_threshold = interp->heap_initial_cells;
+    }
+}
+
+void gc_register_root(Sexp** root) {
+    if (interp->gc_root_count == interp->gc_root_capacity) {
+        size_t capacity = interp->gc_root_capacity ? interp->gc_root_capacity * 2 : 16;
+        Sexp*** grown = (Sexp***)realloc(interp->gc_roots, capacity * sizeof(Sexp**));
+        if (!grown) out_of_memory();
+        interp->gc_roots = grown;
+        interp->gc_root_capacity = capacity;
+    }
+    interp->gc_roots[interp->gc_root_count++] = root;
+}
+
+// Look up a cons cell's bit in its page's mark bitmap
+static bool cons_marked(ConsCell* cell, SlabPage** page_out, size_t* index_out) {
+    SlabPage* page = page_of(cell);
+    size_t index = (size_t)((char*)cell - page->slots) / sizeof(ConsCell);
+    *page_out = page;
+    *index_out = index;
+    return (cons_mark_bits(page)[index / 64] >> (index % 64)) & 1;
+}
+
+static void gc_mark(Sexp* s) {
+    if (sexp_is_cons(s)) {
+        SlabPage* page;
+        size_t index;
+        if (cons_marked(sexp_cons(s), &page, &index)) return;
+    } else if (!sexp_is_pointer(s) || s->marked) {
+        return;
+    }
+    if (interp->mark_top == interp->mark_capacity) {
+        size_t capacity = interp->mark_capacity ? interp->mark_capacity * 2 : 1024;
+        Sexp** grown = (Sexp**)realloc(interp->mark_stack, capacity * sizeof(Sexp*));
+        if (!grown) out_of_memory();
+        interp->mark_stack = grown;
+        interp->mark_capacity = capacity;
+    }
+    interp->mark_stack[interp->mark_top++] = s;
+}
+
+// Drain the mark stack iteratively so long lists don't recurse in C
+static void gc_trace(void) {
+    while (interp->mark_top > 0) {
+        Sexp* s = interp->mark_stack[--interp->mark_top];
+        if (sexp_is_cons(s)) {
+            ConsCell* cell = sexp_cons(s);
+            SlabPage* page;
+            size_t index;
+            if (cons_marked(cell, &page, &index)) continue;
+            cons_mark_bits(page)[index / 64] |= (uint64_t)1 << (index % 64);
+            page->marked++;
+            gc_mark(cell->car);
+            gc_mark(cell->cdr);
+            continue;
+        }
+        if (s->marked) continue;
+        s->marked = true;
+        page_of(s)->marked++;
+
+        switch (s->type) {
+            case LAMBDA_TYPE:
+                gc_mark(s->data.lambda.proto);
+                gc_mark(s->data.lambda.env);
+                break;
+            case PROTO_TYPE:
+                gc_mark(s->data.proto.params);
+                gc_mark(s->data.proto.body);
+                for (int i = 0; i < s->data.proto.info->const_count; i++) {
+                    gc_mark(s->data.proto.info->consts[i]);
+                }
+                gc_mark_jit(s->data.proto.info);
+                break;
+            case FRAME_TYPE:
+                for (int i = 0; i < s->data.frame.proto->data.proto.info->nslots; i++) {
+                    gc_mark(s->data.frame.slots[i]);
+                }
+                gc_mark(s->data.frame.parent);
+                gc_mark(s->data.frame.proto);
+                break;
+            case LOCAL_REF:
+                gc_mark(s->data.ref.symbol);
+                gc_mark(s->data.ref.fallback);
+                break;
+            case GLOBAL_REF:
+                gc_mark(s->data.global.symbol);
+                break;
+            case FOLD_GUARD:
+                gc_mark(s->data.guard.folded);
+                gc_mark(s->data.guard.original);
+                gc_mark(s->data.guard.assumed);
+                break;
+            case ENV_TYPE:
+                gc_mark_env_table(s);
+                break;
+            case FUTURE_TYPE:
+                gc_mark(s->data.future.value);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+// Mark the cell containing addr, if addr points into a live heap cell
+static void gc_mark_candidate(void* addr) {
+    SlabPage* page = page_lookup(addr);
+    if (!page) return;
+
+    char* slots = page_slots(page);
+    if ((char*)addr < slots) return;
+    size_t index = ((char*)addr - slots) / page->slot_size;
+    if (index >= page->used) return;
+
+    if (page->size_class == SLAB_CONS_CLASS) {
+        ConsCell* cell = (ConsCell*)slots + index;
+        if (cell->car != CONS_FREE) {
+            gc_mark((Sexp*)((uintptr_t)cell + SEXP_CONS_TAG));
+        }
+    } else if (page->size_class == SLAB_CELL_CLASS) {
+        Sexp* cell = (Sexp*)slots + index;
+        if (cell->type != FREE_CELL) {
+            gc_mark(cell);
+        }
+    }
+}
+
+#if defined(__SANITIZE_ADDRESS__)
+__attribute__((no_sanitize_address))
+#endif
+static __attribute__((noinline)) void gc_scan_stack(void) {
+    void* top = __builtin_frame_address(0);
+    char* lo = (char*)top;
+    char* hi = (char*)thread_stack_bottom();
+    if (lo > hi) {
+        char* tmp = lo;
+        lo = hi;
+        hi = tmp;
+    }
+    lo = (char*)((size_t)lo & ~(sizeof(void*) - 1));
+    for (char* p = lo; p + sizeof(void*) <= hi; p += sizeof(void*)) {
+        gc_mark_candidate(*(void**)p);
+    }
+}
+
+// Free what a dead cell owns outside its slot (text, tables, code)
+static void release_cell(SlabPage* page, Sexp* cell) {
+    if (cell->type == ATOM_SYMBOL) {
+        heap_free_bytes(cell->data.symbol);
+        page->owners--;
+    } else if (cell->type == ATOM_STRING) {
+        heap_free_bytes(cell->data.string);
+        page->owners--;
+    } else if (cell->type == ENV_TYPE) {
+        free_table_env(cell);
+        page->owners--;
+    } else if (cell->type == FRAME_TYPE) {
+        heap_free_bytes(cell->data.frame.slots);
+        page->owners--;
+    } else if (cell->type == PROTO_TYPE) {
+        free_proto_info(cell);
+        page->owners--;
+    } else if (cell->type == FUTURE_TYPE) {
+        if (cell->data.future.task) future_release(cell->data.future.task);
+        page->owners--;
+    }
+}
+
+static void gc_sweep(void) {
+    SlabPage** link = &interp->cell_pages;
+    interp->free_list = NULL;
+    interp->cells_in_use = 0;
+
+    while (*link) {
+        SlabPage* page = *link;
+        Sexp* cells = (Sexp*)page_slots(page);
+
+        if (page->marked == 0 && page->owners == 0 && page != interp->cell_bump_page) {
+            // Nothing survived and nothing needs freeing: drop the page whole
+            *link = page->next;
+            interp->heap_cells -= page->slot_count;
+            page_release(page);
+            continue;
+        }
+
+        // Walk backwards so the rebuilt free list comes out in address order
+        // within each page
+        Sexp* page_free = NULL;
+        Sexp* page_free_tail = NULL;
+        for (size_t j = page->used; j > 0; j--) {
+            Sexp* cell = &cells[j - 1];
+            if (cell->marked) {
+                cell->marked = false;
+                interp->cells_in_use++;
+                continue;
+            }
+            release_cell(page, cell);
+            cell->type = FREE_CELL;
+            cell->data.next_free = page_free;
+            page_free = cell;
+            if (!page_free_tail) page_free_tail = cell;
+        }
+        if (page_free) {
+            page_free_tail->data.next_free = interp->free_list;
+            interp->free_list = page_free;
+        }
+        page->marked = 0;
+        link = &page->next;
+    }
+}
+
+// Cons pages own nothing, so only the mark bitmap decides what's freed
+static void gc_sweep_conses(void) {
+    SlabPage** link = &interp->cons_pages;
+    interp->cons_free_list = NULL;
+
+    while (*link) {
+        SlabPage* page = *link;
+        ConsCell* cells = (ConsCell*)page_slots(page);
+
+        if (page->marked == 0 && page != interp->cons_bump_page) {
+            *link = page->next;
+            interp->heap_cells -= page->slot_count;
+            page_release(page);
+            continue;
+        }
+
+        ConsCell* page_free = NULL;
+        ConsCell* page_free_tail = NULL;
+        for (size_t j = page->used; j > 0; j--) {
+            size_t index = j - 1;
+            if ((cons_mark_bits(page)[index / 64] >> (index % 64)) & 1) {
+                interp->cells_in_use++;
+                continue;
+            }
+            ConsCell* cell = &cells[index];
+            cell->car = CONS_FREE;
+            cell->cdr = (Sexp*)page_free;
+            page_free = cell;
+            if (!page_free_tail) page_free_tail = cell;
+        }
+        if (page_free) {
+            page_free_tail->cdr = (Sexp*)interp->cons_free_list;
+            interp->cons_free_list = page_free;
+        }
+        memset(cons_mark_bits(page), 0, CONS_MARK_WORDS * sizeof(uint64_t));
+        page->marked = 0;
+        link = &page->next;
+    }
+}
+
+void gc_collect(void) {
+    jmp_buf registers;
+
+    gc_find_stack_bottom();
+
+    // Spill callee-saved registers into this frame so the scan sees them
+    setjmp(registers);
+    gc_scan_stack();
+
+    gc_mark(NIL);
+    gc_mark(TRUE_SEXP);
+    gc_mark(GLOBAL_ENV);
+    gc_mark(interp->global_snapshot);
+    for (size_t i = 0; i < interp->symbol_capacity; i++) {
+        gc_mark(interp->symbol_table[i]);
+    }
+    for (size_t i = 0; i < interp->gc_root_count; i++) {
+        gc_mark(*interp->gc_roots[i]);
+    }
+    gc_mark_frame_stack();
+    gc_mark_arg_stack();
+    gc_mark_eval_stack();
+    gc_mark_vm();
+    gc_mark_reader();
+    gc_trace();
+    gc_sweep();
+    gc_sweep_conses();
+
+    // Let the heap grow to twice the live data before the next collection
+    interp->heap_threshold = interp->cells_in_use * 2;
+    if (interp->heap_threshold < interp->heap_initial_cells) {
+        interp->heap_threshold = interp->heap_initial_cells;
+    }
+}
+
+size_t gc_live_cells(void) {
+    return interp->cells_in_use;
+}
+
+size_t gc_heap_cells(void) {
+    return interp->heap_cells;
+}
+
+// Carve the next slot from a class's bump page, starting a new page when
+// it is full. Returns NULL at the heap limit, unless the heap is already
+// exhausted and the evaluation is unwinding.
+static void* bump_slot(SlabPage** pages, SlabPage** bump_page, int size_class, size_t slot_size) {
+    SlabPage* page = *bump_page;
+    if (!page || page->used == page->slot_count) {
+        if (interp->heap_max_cells && !interp->heap_exhausted &&
+            interp->heap_cells + (SLAB_PAGE_SIZE / slot_size) > interp->heap_max_cells) {
+            return NULL;
+        }
+        page = page_new(size_class, slot_size);
+        page->next = *pages;
+        *pages = page;
+        *bump_page = page;
+        interp->heap_cells += page->slot_count;
+    }
+    return page_slots(page) + page->used++ * slot_size;
+}
+
+// Still at the heap limit after a full collection. The evaluation unwinds
+// as it does from a stack overflow, returning ERROR:OUT_OF_MEMORY; what it
+// allocates until then goes past the limit, and is collected once it is
+// over.
+static void heap_exhausted(void) {
+    interp->heap_exhausted = true;
+    interp->stack_overflowed = true;
+}
+
+Sexp* allocate_sexp() {
+    LOCAL_INTERP;
+    gc_find_stack_bottom();
+#ifdef GC_STRESS
+    if (interp->heap_cells) gc_collect();
+#else
+    if (!interp->free_list && interp->cells_in_use >= interp->heap_threshold) {
+        gc_collect();
+    }
+#endif
+
+    Sexp* s = interp->free_list;
+    if (s) {
+        interp->free_list = s->data.next_free;
+    } else {
+        s = (Sexp*)bump_slot(&interp->cell_pages, &interp->cell_bump_page,
+                             SLAB_CELL_CLASS, sizeof(Sexp));
+        if (!s) {
+            // At the heap limit: a last-ditch collection before giving up
+            gc_collect();
+            s = interp->free_list;
+            if (s) {
+                interp->free_list = s->data.next_free;
+            } else {
+                heap_exhausted();
+                s = (Sexp*)bump_slot(&interp->cell_pages, &interp->cell_bump_page,
+                                     SLAB_CELL_CLASS, sizeof(Sexp));
+            }
+        }
+    }
+    interp->cells_in_use++;
+    s->marked = false;
+    return s;
+}
+
+static ConsCell* allocate_cons(void) {
+    LOCAL_INTERP;
+    gc_find_stack_bottom();
+#ifdef GC_STRESS
+    if (interp->heap_cells) gc_collect();
+#else
+    if (!interp->cons_free_list && interp->cells_in_use >= interp->heap_threshold) {
+        gc_collect();
+    }
+#endif
+
+    ConsCell* cell = interp->cons_free_list;
+    if (cell) {
+        interp->cons_free_list = (ConsCell*)cell->cdr;
+    } else {
+        cell = (ConsCell*)bump_slot(&interp->cons_pages, &interp->cons_bump_page,
+                                    SLAB_CONS_CLASS, sizeof(ConsCell));
+        if (!cell) {
+            gc_collect();
+            cell = interp->cons_free_list;
+            if (cell) {
+                interp->cons_free_list = (ConsCell*)cell->cdr;
+            } else {
+                heap_exhausted();
+                cell = (ConsCell*)bump_slot(&interp->cons_pages, &interp->cons_bump_page,
+                                            SLAB_CONS_CLASS, sizeof(ConsCell));
+            }
+        }
+    }
+    interp->cells_in_use++;
+    return cell;
+}
+
+// Bump-pointer scratch memory for short-lived buffers such as reader
+// tokens. Callers release back to a mark when done; the REPL also resets
+// the whole arena after each top-level form.
+void* scratch_alloc(size_t size) {
+    size = (size + 7) & ~(size_t)7;
+    struct ArenaChunk* chunk = interp->scratch_chunks;
+    if (!chunk || chunk->used + size > chunk->size) {
+        size_t chunk_size = size > 4096 ? size : 4096;
+        chunk = (struct ArenaChunk*)malloc(sizeof(struct ArenaChunk) + chunk_size);
+        if (!chunk) out_of_memory();
+        chunk->next = interp->scratch_chunks;
+        chunk->size = chunk_size;
+        chunk->used = 0;
+        interp->scratch_chunks = chunk;
+    }
+    void* p = (char*)(chunk + 1) + chunk->used;
+    chunk->used += size;
+    return p;
+}
+
+ScratchMark scratch_mark(void) {
+    ScratchMark mark;
+    mark.chunk = interp->scratch_chunks;
+    mark.used = interp->scratch_chunks ? interp->scratch_chunks->used : 0;
+    return mark;
+}
+
+// Release everything allocated since mark was taken
+void scratch_release(ScratchMark mark) {
+    while (interp->scratch_chunks && interp->scratch_chunks != mark.chunk) {
+        struct ArenaChunk* next = interp->scratch_chunks->next;
+        free(interp->scratch_chunks);
+        interp->scratch_chunks = next;
+    }
+    if (interp->scratch_chunks) interp->scratch_chunks->used = mark.used;
+}
+
+void heap_reset_scratch(void) {
+    // Keep the oldest chunk around for the next form
+    while (interp->scratch_chunks && interp->scratch_chunks->next) {
+        struct ArenaChunk* next = interp->scratch_chunks->next;
+        free(interp->scratch_chunks);
+        interp->scratch_chunks = next;
+    }
+    if (interp->scratch_chunks) interp->scratch_chunks->used = 0;
+}
+
+// ============================================================================
+// FRAME STACK
+// ============================================================================
+
+// Frames of lambdas and lets whose bodies can't create a closure (see
+// ProtoInfo.stack_frames) can never be referenced once their call returns,
+// so they come from a LIFO region instead of the heap and are popped on
+// return. Each record is a FRAME Sexp with its slots right after it.
+// Records are permanently marked, so the collector never traces or sweeps
+// them; gc_mark_frame_stack() marks what their slots hold instead.
+
+#define FRAME_CHUNK_SIZE 65536
+
+struct FrameChunk {
+    struct FrameChunk* next;     // Older chunk
+    size_t size;
+    size_t used;
+};
+
+typedef struct {
+    struct FrameChunk* chunk;
+    size_t used;
+} FrameMark;
+
+static size_t frame_record_size(int nslots) {
+    return (sizeof(Sexp) + (size_t)nslots * sizeof(Sexp*) + 7) & ~(size_t)7;
+}
+
+static FrameMark frame_stack_mark(void) {
+    FrameMark mark;
+    mark.chunk = interp->frame_chunks;
+    mark.used = interp->frame_chunks ? interp->frame_chunks->used : 0;
+    return mark;
+}
+
+// Pop every frame pushed since mark. One emptied chunk is kept, so a
+// recursion going back and forth across a chunk boundary doesn't malloc.
+static inline void frame_stack_release(FrameMark mark) {
+    while (interp->frame_chunks != mark.chunk) {
+        struct FrameChunk* chunk = interp->frame_chunks;
+        interp->frame_chunks = chunk->next;
+        free(interp->spare_frame_chunk);
+        interp->spare_frame_chunk = chunk;
+    }
+    if (interp->frame_chunks) interp->frame_chunks->used = mark.used;
+}
+
+// Pop frame, which must be the newest record
+static void frame_stack_pop(Sexp* frame) {
+    interp->frame_chunks->used = (size_t)((char*)frame - (char*)(interp->frame_chunks + 1));
+}
+
+static Sexp* frame_stack_push(Sexp* proto, Sexp* parent) {
+    int nslots = proto->data.proto.info->nslots;
+    size_t size = frame_record_size(nslots);
+    struct FrameChunk* chunk = interp->frame_chunks;
+    if (!chunk || chunk->used + size > chunk->size) {
+        if (interp->spare_frame_chunk && interp->spare_frame_chunk->size >= size) {
+            chunk = interp->spare_frame_chunk;
+            interp->spare_frame_chunk = NULL;
+        } else {
+            size_t chunk_size = size > FRAME_CHUNK_SIZE ? size : FRAME_CHUNK_SIZE;
+            chunk = (struct FrameChunk*)malloc(sizeof(struct FrameChunk) + chunk_size);
+            if (!chunk) out_of_memory();
+            chunk->size = chunk_size;
+        }
+        chunk->next = interp->frame_chunks;
+        chunk->used = 0;
+        interp->frame_chunks = chunk;
+    }
+
+    Sexp* s = (Sexp*)((char*)(chunk + 1) + chunk->used);
+    chunk->used += size;
+    s->type = FRAME_TYPE;
+    s->marked = true;
+    s->data.frame.slots = (Sexp**)(s + 1);
+    s->data.frame.parent = parent;
+    s->data.frame.proto = proto;
+    return s;
+}
+
+static void gc_mark_frame_stack(void) {
+    for (struct FrameChunk* chunk = interp->frame_chunks; chunk; chunk = chunk->next) {
+        char* p = (char*)(chunk + 1);
+        char* end = p + chunk->used;
+        while (p < end) {
+            Sexp* frame = (Sexp*)p;
+            int nslots = frame->data.frame.proto->data.proto.info->nslots;
+            for (int i = 0; i < nslots; i++) {
+                gc_mark(frame->data.frame.slots[i]);
+            }
+            gc_mark(frame->data.frame.parent);
+            gc_mark(frame->data.frame.proto);
+            p += frame_record_size(nslots);
+        }
+    }
+}
+
+// ============================================================================
+// SYMBOL TABLE
+// ============================================================================
+
+// Every symbol name maps to exactly one symbol object, so symbols can be
+// compared by pointer. The table uses open addressing with linear probing
+// and is a GC root, so interned symbols live for the whole session.
+
+static size_t hash_name(const char* name) {
+    size_t h = 2166136261u;
+    while (*name) {
+        h ^= (unsigned char)*name++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static void symbol_table_grow(void) {
+    size_t capacity = interp->symbol_capacity ? interp->symbol_capacity * 2 : 256;
+    Sexp** table = (Sexp**)calloc(capacity, sizeof(Sexp*));
+    if (!table) out_of_memory();
+
+    for (size_t i = 0; i < interp->symbol_capacity; i++) {
+        Sexp* sym = interp->symbol_table[i];
+        if (!sym) continue;
+        size_t j = hash_name(sym->data.symbol) & (capacity - 1);
+        while (table[j]) j = (j + 1) & (capacity - 1);
+        table[j] = sym;
+    }
+    free(interp->symbol_table);
+    interp->symbol_table = table;
+    interp->symbol_capacity = capacity;
+}
+
+Sexp* intern(const char* name) {
+#ifdef LISP_NAN_BOXING
+    // T is an immediate value, not a heap symbol
+    if (name[0] == 'T' && name[1] == '\0') {
+        return (Sexp*)SEXP_TRUE_BITS;
+    }
+#endif
+    if (interp->symbol_count * 2 >= interp->symbol_capacity) {
+        symbol_table_grow();
+    }
+
+    size_t i = hash_name(name) & (interp->symbol_capacity - 1);
+    while (interp->symbol_table[i]) {
+        if (strcmp(interp->symbol_table[i]->data.symbol, name) == 0) {
+            return interp->symbol_table[i];
+        }
+        i = (i + 1) & (interp->symbol_capacity - 1);
+    }
+
+    Sexp* s = allocate_sexp();
+    s->type = ATOM_SYMBOL;
+    s->form = FORM_NONE;
+    s->data.symbol = heap_strdup(name);
+    page_of(s)->owners++;
+
+    // The allocation may have collected, but never resizes the table
+    interp->symbol_table[i] = s;
+    interp->symbol_count++;
+    return s;
+}
+
+// ============================================================================
+// SPRINT 1: CONSTRUCTORS
+// ============================================================================
+
+#ifdef LISP_NAN_BOXING
+
+Sexp* nil() {
+    return NIL;
+}
+
+Sexp* true_sexp() {
+    return TRUE_SEXP;
+}
+
+#else
+
+// Each Interp makes its own on first use
+Sexp* nil() {
+    if (!NIL) {
+        NIL = allocate_sexp();
+        NIL->type = NIL_TYPE;
+    }
+    return NIL;
+}
+
+Sexp* true_sexp() {
+    if (!TRUE_SEXP) {
+        TRUE_SEXP = intern("T");
+    }
+    return TRUE_SEXP;
+}
+
+#endif
+
+static Sexp* make_boxed_integer(int64_t value) {
+    Sexp* s = allocate_sexp();
+    s->type = ATOM_INTEGER;
+    s->data.integer = value;
+    return s;
+}
+
+#ifdef LISP_NAN_BOXING
+
+Sexp* make_number(double value) {
+    return sexp_box_number(value);
+}
+
+// Integers that fit in 48 bits are immediates; only larger ones allocate
+Sexp* make_integer(int64_t value) {
+    if (value >= SEXP_FIXNUM_MIN && value <= SEXP_FIXNUM_MAX) {
+        return sexp_box_fixnum(value);
+    }
+    return make_boxed_integer(value);
+}
+
+#else
+
+// Preallocated cells for common small integers. They live outside the
+// heap and are permanently marked, so the collector never touches them.
+// Being immutable, they are shared by every Interp.
+#define SMALL_INTEGER_MIN -128
+#define SMALL_INTEGER_MAX 1023
+
+static Sexp small_integers[SMALL_INTEGER_MAX - SMALL_INTEGER_MIN + 1];
+static pthread_once_t small_integers_once = PTHREAD_ONCE_INIT;
+static bool small_integers_ready = false;
+
+static void init_small_integers(void) {
+    for (int i = SMALL_INTEGER_MIN; i <= SMALL_INTEGER_MAX; i++) {
+        Sexp* s = &small_integers[i - SMALL_INTEGER_MIN];
+        s->type = ATOM_INTEGER;
+        s->marked = true;
+        s->data.integer = i;
+    }
+    __atomic_store_n(&small_integers_ready, true, __ATOMIC_RELEASE);
+}
+
+Sexp* make_number(double value) {
+    Sexp* s = allocate_sexp();
+    s->type = ATOM_NUMBER;
+    s->data.number = value;
+    return s;
+}
+
+Sexp* make_integer(int64_t value) {
+    if (value >= SMALL_INTEGER_MIN && value <= SMALL_INTEGER_MAX) {
+        if (!__atomic_load_n(&small_integers_ready, __ATOMIC_ACQUIRE)) {
+            pthread_once(&small_integers_once, init_small_integers);
+        }
+        return &small_integers[value - SMALL_INTEGER_MIN];
+    }
+    return make_boxed_integer(value);
+}
+
+#endif
+
+Sexp* make_symbol(const char* value) {
+    return intern(value);
+}
+
+Sexp* make_string(const char* value) {
+    Sexp* s = allocate_sexp();
+    s->type = ATOM_STRING;
+    s->data.string = heap_strdup(value);
+    page_of(s)->owners++;
+    return s;
+}
+
+Sexp* cons(Sexp* car, Sexp* cdr) {
+    ConsCell* cell = allocate_cons();
+    cell->car = car;
+    cell->cdr = cdr;
+    return (Sexp*)((uintptr_t)cell + SEXP_CONS_TAG);
+}
+
+// Resolve body against the scopes visible from env (see LEXICAL ADDRESSING)
+Sexp* make_lambda(Sexp* params, Sexp* body, Sexp* env) {
+    return make_closure(make_proto(params, body, env), env);
+}
+
+Sexp* make_closure(Sexp* proto, Sexp* env) {
+    Sexp* s = allocate_sexp();
+    s->type = LAMBDA_TYPE;
+    s->data.lambda.proto = proto;
+    s->data.lambda.env = env;
+    return s;
+}
+
+Sexp* make_primitive_arity(PrimitiveFunc func, int min_args, int max_args) {
+    Sexp* s = allocate_sexp();
+    s->type = PRIMITIVE_TYPE;
+    s->data.primitive.func = func;
+    s->data.primitive.min_args = min_args;
+    s->data.primitive.max_args = max_args;
+    return s;
+}
+
+Sexp* make_primitive(PrimitiveFunc func) {
+    return make_primitive_arity(func, 0, ARITY_VARIADIC);
+}
+
+// ============================================================================
+// SPRINT 2: PREDICATES
+// ============================================================================
+
+bool isNil(Sexp* s) {
+    return sexp_is_nil(s);
+}
+
+bool isNumber(Sexp* s) {
+    if (!s) return false;
+    SexpType type = sexp_type(s);
+    return type == ATOM_NUMBER || type == ATOM_INTEGER;
+}
+
+bool isInteger(Sexp* s) {
+    return s && sexp_type(s) == ATOM_INTEGER;
+}
+
+bool isSymbol(Sexp* s) {
+    return s && sexp_type(s) == ATOM_SYMBOL;
+}
+
+bool isString(Sexp* s) {
+    return s && sexp_type(s) == ATOM_STRING;
+}
+
+bool isList(Sexp* s) {
+    return isNil(s) || (s && sexp_type(s) == CONS_CELL);
+}
+
+bool isTrueSexp(Sexp* s) {
+    return !isNil(s);
+}
+
+bool isLambda(Sexp* s) {
+    return s && sexp_type(s) == LAMBDA_TYPE;
+}
+
+bool isPrimitive(Sexp* s) {
+    return s && sexp_type(s) == PRIMITIVE_TYPE;
+}
+
+// ============================================================================
+// SPRINT 2: ACCESSORS
+// ============================================================================
+
+Sexp* car(Sexp* s) {
+    if (!sexp_is_cons(s)) {
+        fprintf(stderr, "Error: car called on non-cons cell\n");
+        return nil();
+    }
+    return sexp_cons(s)->car;
+}
+
+Sexp* cdr(Sexp* s) {
+    if (!sexp_is_cons(s)) {
+        fprintf(stderr, "Error: cdr called on non-cons cell\n");
+        return nil();
+    }
+    return sexp_cons(s)->cdr;
+}
+
+Sexp* cadr(Sexp* s) {
+    return car(cdr(s));
+}
+
+Sexp* caddr(Sexp* s) {
+    return car(cdr(cdr(s)));
+}
+
+Sexp* cadddr(Sexp* s) {
+    return car(cdr(cdr(cdr(s))));
+}
+
+Sexp* cddr(Sexp* s) {
+    return cdr(cdr(s));
+}
+
+Sexp* cdddr(Sexp* s) {
+    return cdr(cdr(cdr(s)));
+}
+
+// ============================================================================
+// SPRINT 2: ADDITIONAL FUNCTIONS
+// ============================================================================
+
+bool eq(Sexp* a, Sexp* b) {
+    if (sexp_is_fixnum(a) && sexp_is_fixnum(b)) return a == b;
+    if (isNil(a) && isNil(b)) return true;
+    if (isNil(a) || isNil(b)) return false;
+    if (isNumber(a) && isNumber(b)) {
+        if (isInteger(a) && isInteger(b)) return sexp_integer(a) == sexp_integer(b);
+        return sexp_as_double(a) == sexp_as_double(b);
+    }
+    if (sexp_type(a) != sexp_type(b)) return false;
+    
+    switch (sexp_type(a)) {
+        case ATOM_SYMBOL:
+            return a == b;
+        case ATOM_STRING:
+            return strcmp(a->data.string, b->data.string) == 0;
+        case CONS_CELL:
+            return a == b;
+        default:
+            return false;
+    }
+}
+
+bool null(Sexp* s) {
+    return isNil(s);
+}
+
+// ============================================================================
+// SPRINT 3: ARITHMETIC FUNCTIONS
+// ============================================================================
+
+// Integer operands take an exact, overflow-checked path; a double on
+// either side, or an integer overflow, falls back to double arithmetic.
+static inline bool integer_operands(Sexp* a, Sexp* b, int64_t* x, int64_t* y) {
+    if (sexp_is_fixnum(a) && sexp_is_fixnum(b)) {
+        *x = sexp_integer(a);
+        *y = sexp_integer(b);
+        return true;
+    }
+    if (!isInteger(a) || !isInteger(b)) return false;
+    *x = sexp_integer(a);
+    *y = sexp_integer(b);
+    return true;
+}
+
+Sexp* add(Sexp* a, Sexp* b) {
+    int64_t x, y, result;
+    if (integer_operands(a, b, &x, &y) && !__builtin_add_overflow(x, y, &result)) {
+        return make_integer(result);
+    }
+    if (!isNumber(a) || !isNumber(b)) {
+        return make_symbol("ERROR:NOT_A_NUMBER");
+    }
+    return make_number(sexp_as_double(a) + sexp_as_double(b));
+}
+
+Sexp* sub(Sexp* a, Sexp* b) {
+    int64_t x, y, result;
+    if (integer_operands(a, b, &x, &y) && !__builtin_sub_overflow(x, y, &result)) {
+        return make_integer(result);
+    }
+    if (!isNumber(a) || !isNumber(b)) {
+        return make_symbol("ERROR:NOT_A_NUMBER");
+    }
+    return make_number(sexp_as_double(a) - sexp_as_double(b));
+}
+
+Sexp* mul(Sexp* a, Sexp* b) {
+    int64_t x, y, result;
+    if (integer_operands(a, b, &x, &y) && !__builtin_mul_overflow(x, y, &result)) {
+        return make_integer(result);
+    }
+    if (!isNumber(a) || !isNumber(b)) {
+        return make_symbol("ERROR:NOT_A_NUMBER");
+    }
+    return make_number(sexp_as_double(a) * sexp_as_double(b));
+}
+
+// Exact quotients of integers stay integers; anything else is a double
+Sexp* divide(Sexp* a, Sexp* b) {
+    int64_t x, y, result;
+    if (integer_operands(a, b, &x, &y)) {
+        if (y == 0) {
+            return make_symbol("ERROR:DIVISION_BY_ZERO");
+        }
+        // x / -1 overflows for INT64_MIN, and x % -1 may trap
+        if (y == -1) {
+            if (!__builtin_sub_overflow(0, x, &result)) return make_integer(result);
+        } else if (x % y == 0) {
+            return make_integer(x / y);
+        }
+    }
+    if (!isNumber(a) || !isNumber(b)) {
+        return make_symbol("ERROR:NOT_A_NUMBER");
+    }
+    if (sexp_as_double(b) == 0) {
+        return make_symbol("ERROR:DIVISION_BY_ZERO");
+    }
+    return make_number(sexp_as_double(a) / sexp_as_double(b));
+}
+
+// Remainder truncates toward zero, like C's %
+Sexp* mod(Sexp* a, Sexp* b) {
+    int64_t x, y;
+    if (integer_operands(a, b, &x, &y)) {
+        if (y == 0) {
+            return make_symbol("ERROR:DIVISION_BY_ZERO");
+        }
+        return make_integer(y == -1 ? 0 : x % y);
+    }
+    if (!isNumber(a) || !isNumber(b)) {
+        return make_symbol("ERROR:NOT_A_NUMBER");
+    }
+    if (sexp_as_double(b) == 0) {
+        return make_symbol("ERROR:DIVISION_BY_ZERO");
+    }
+    return make_number(fmod(sexp_as_double(a), sexp_as_double(b)));
+}
+
+// ============================================================================
+// SPRINT 3: COMPARISON FUNCTIONS
+// ============================================================================
+
+// Order two values as -1, 0 or 1 for a < b, a == b, a > b. Two integers
+// compare exactly; a NaN is unordered and anything else is not a number.
+#define ORDER_UNORDERED     2
+#define ORDER_NOT_A_NUMBER  3
+
+static inline int num_compare(Sexp* a, Sexp* b) {
+    int64_t x, y;
+    if (integer_operands(a, b, &x, &y)) {
+        return (x > y) - (x < y);
+    }
+    if (!isNumber(a) || !isNumber(b)) return ORDER_NOT_A_NUMBER;
+    double p = sexp_as_double(a);
+    double q = sexp_as_double(b);
+    if (p < q) return -1;
+    if (p > q) return 1;
+    return p == q ? 0 : ORDER_UNORDERED;
+}
+
+Sexp* lt(Sexp* a, Sexp* b) {
+    int order = num_compare(a, b);
+    if (order == ORDER_NOT_A_NUMBER) {
+        return make_symbol("ERROR:NOT_A_NUMBER");
+    }
+    return order == -1 ? true_sexp() : nil();
+}
+
+Sexp* gt(Sexp* a, Sexp* b) {
+    int order = num_compare(a, b);
+    if (order == ORDER_NOT_A_NUMBER) {
+        return make_symbol("ERROR:NOT_A_NUMBER");
+    }
+    return order == 1 ? true_sexp() : nil();
+}
+
+Sexp* lte(Sexp* a, Sexp* b) {
+    int order = num_compare(a, b);
+    if (order == ORDER_NOT_A_NUMBER) {
+        return make_symbol("ERROR:NOT_A_NUMBER");
+    }
+    return (order == -1 || order == 0) ? true_sexp() : nil();
+}
+
+Sexp* gte(Sexp* a, Sexp* b) {
+    int order = num_compare(a, b);
+    if (order == ORDER_NOT_A_NUMBER) {
+        return make_symbol("ERROR:NOT_A_NUMBER");
+    }
+    return (order == 1 || order == 0) ? true_sexp() : nil();
+}
+
+Sexp* not(Sexp* s) {
+    return isNil(s) ? true_sexp() : nil();
+}
+
+// ============================================================================
+// SPRINT 5: ENVIRONMENT MANAGEMENT
+// ============================================================================
+
+// Local frames are ((symbols . values) . parent). The global frame is an
+// ENV_TYPE cell holding an open-addressing hash table keyed by interned
+// symbol, so global lookups stay O(1) and rebinding a global updates its
+// slot instead of growing a list.
+//
+// GLOBAL_REF cells cache a pointer to the binding they last found. Rebinding
+// a global writes through that same binding, so only moving or freeing the
+// bindings array invalidates a cache; both bump global_version.
+
+typedef struct EnvBinding {
+    Sexp* symbol;
+    Sexp* value;
+} EnvBinding;
+
+struct EnvTable {
+    size_t capacity;
+    size_t count;
+    EnvBinding* bindings;
+};
+
+static size_t hash_symbol(Sexp* symbol) {
+    size_t h = (size_t)symbol;
+    h ^= h >> 4;
+    h *= 0x9E3779B1u;
+    return h ^ (h >> 16);
+}
+
+static EnvBinding* table_find(EnvTable* table, Sexp* symbol) {
+    size_t mask = table->capacity - 1;
+    size_t i = hash_symbol(symbol) & mask;
+    while (table->bindings[i].symbol) {
+        if (table->bindings[i].symbol == symbol) {
+            return &table->bindings[i];
+        }
+        i = (i + 1) & mask;
+    }
+    return &table->bindings[i];  // Empty slot where symbol would go
+}
+
+static void table_grow(EnvTable* table) {
+    EnvTable grown;
+    grown.capacity = table->capacity * 2;
+    grown.count = table->count;
+    grown.bindings = (EnvBinding*)calloc(grown.capacity, sizeof(EnvBinding));
+    if (!grown.bindings) out_of_memory();
+
+    for (size_t i = 0; i < table->capacity; i++) {
+        if (table->bindings[i].symbol) {
+            *table_find(&grown, table->bindings[i].symbol) = table->bindings[i];
+        }
+    }
+    free(table->bindings);
+    *table = grown;
+    interp->global_version++;
+}
+
+Sexp* make_table_env(Sexp* parent) {
+    EnvTable* table = (EnvTable*)malloc(sizeof(EnvTable));
+    if (!table) out_of_memory();
+    table->capacity = 64;
+    table->count = 0;
+    table->bindings = (EnvBinding*)calloc(table->capacity, sizeof(EnvBinding));
+    if (!table->bindings) out_of_memory();
+
+    Sexp* s = allocate_sexp();
+    s->type = ENV_TYPE;
+    s->data.env.table = table;
+    s->data.env.parent = parent;
+    page_of(s)->owners++;
+    return s;
+}
+
+static void gc_mark_env_table(Sexp* env) {
+    EnvTable* table = env->data.env.table;
+    for (size_t i = 0; i < table->capacity; i++) {
+        if (table->bindings[i].symbol) {
+            gc_mark(table->bindings[i].symbol);
+            gc_mark(table->bindings[i].value);
+        }
+    }
+    gc_mark(env->data.env.parent);
+}
+
+static void free_table_env(Sexp* env) {
+    free(env->data.env.table->bindings);
+    free(env->data.env.table);
+    interp->global_version++;
+}
+
+Sexp* make_env(Sexp* symbols, Sexp* values, Sexp* parent) {
+    return cons(cons(symbols, values), parent);
+}
+
+Sexp* env_symbols(Sexp* env) {
+    if (isNil(env)) return nil();
+    if (sexp_type(env) == FRAME_TYPE) return env->data.frame.proto->data.proto.params;
+    if (sexp_type(env) == ENV_TYPE) {
+        EnvTable* table = env->data.env.table;
+        Sexp* symbols = nil();
+        for (size_t i = 0; i < table->capacity; i++) {
+            if (table->bindings[i].symbol) {
+                symbols = cons(table->bindings[i].symbol, symbols);
+            }
+        }
+        return symbols;
+    }
+    return car(car(env));
+}
+
+Sexp* env_values(Sexp* env) {
+    if (isNil(env)) return nil();
+    if (sexp_type(env) == FRAME_TYPE) {
+        // Parameter values, in the same order as env_symbols()
+        Sexp* values = nil();
+        for (int i = env->data.frame.proto->data.proto.info->arity; i > 0; i--) {
+            values = cons(env->data.frame.slots[i - 1], values);
+        }
+        return values;
+    }
+    if (sexp_type(env) == ENV_TYPE) {
+        // Same order as env_symbols()
+        EnvTable* table = env->data.env.table;
+        Sexp* values = nil();
+        for (size_t i = 0; i < table->capacity; i++) {
+            if (table->bindings[i].symbol) {
+                values = cons(table->bindings[i].value, values);
+            }
+        }
+        return values;
+    }
+    return cdr(car(env));
+}
+
+Sexp* env_parent(Sexp* env) {
+    if (isNil(env)) return nil();
+    if (sexp_type(env) == ENV_TYPE) return env->data.env.parent;
+    if (sexp_type(env) == FRAME_TYPE) return env->data.frame.parent;
+    return cdr(env);
+}
+
+Sexp* env_set(Sexp* env, Sexp* symbol, Sexp* value) {
+    if (sexp_type(env) == ENV_TYPE) {
+        EnvTable* table = env->data.env.table;
+        if ((table->count + 1) * 2 > table->capacity) {
+            table_grow(table);
+        }
+        EnvBinding* binding = table_find(table, symbol);
+        if (!binding->symbol) {
+            binding->symbol = symbol;
+            table->count++;
+        }
+        binding->value = value;
+        return value;
+    }
+    
+    if (sexp_type(env) == FRAME_TYPE) {
+        // A frame's layout is fixed; rebind a parameter or pass it outward
+        int i = 0;
+        for (Sexp* p = env_symbols(env); !isNil(p); p = cdr(p), i++) {
+            if (car(p) == symbol) {
+                env->data.frame.slots[i] = value;
+                return value;
+            }
+        }
+        return env_set(env->data.frame.parent, symbol, value);
+    }
+    
+    Sexp* symbols = env_symbols(env);
+    Sexp* values = env_values(env);
+    
+    // Add to the front of both lists
+    Sexp* new_symbols = cons(symbol, symbols);
+    Sexp* new_values = cons(value, values);
+    
+    // Update the environment
+    sexp_cons(env)->car = cons(new_symbols, new_values);
+    return value;
+}
+
+Sexp* env_lookup(Sexp* env, Sexp* symbol) {
+    while (!isNil(env)) {
+        if (sexp_type(env) == ENV_TYPE) {
+            EnvBinding* binding = table_find(env->data.env.table, symbol);
+            if (binding->symbol) {
+                return binding->value;
+            }
+            env = env->data.env.parent;
+            continue;
+        }
+        
+        if (sexp_type(env) == FRAME_TYPE) {
+            int i = 0;
+            for (Sexp* p = env_symbols(env); !isNil(p); p = cdr(p), i++) {
+                if (car(p) == symbol) {
+                    return env->data.frame.slots[i];
+                }
+            }
+            env = env->data.frame.parent;
+            continue;
+        }
+        
+        Sexp* symbols = env_symbols(env);
+        Sexp* values = env_values(env);
+        
+        while (!isNil(symbols)) {
+            if (car(symbols) == symbol) {
+                return car(values);
+            }
+            symbols = cdr(symbols);
+            values = cdr(values);
+        }
+        env = env_parent(env);
+    }
+    
+    // Symbol not found - return undefined message
+    return make_symbol("UNDEFINED");
+}
+
+// Slow path of global_ref_value: look the name up past the resolved frames,
+// which the resolver has established don't bind it, and cache the binding
+// if it lives in a global table
+static Sexp* global_ref_miss(Sexp* ref, Sexp* env) {
+    Sexp* symbol = ref->data.global.symbol;
+    while (sexp_type(env) == FRAME_TYPE) {
+        env = env->data.frame.parent;
+    }
+    if (sexp_type(env) == ENV_TYPE) {
+        EnvBinding* binding = table_find(env->data.env.table, symbol);
+        if (binding->symbol) {
+            ref->data.global.binding = binding;
+            ref->data.global.version = interp->global_version;
+            return binding->value;
+        }
+    }
+    return env_lookup(env, symbol);
+}
+
+// Value of a free name at a resolved reference: one compare on a cache hit
+static inline Sexp* global_ref_value(Sexp* ref, Sexp* env) {
+    if (ref->data.global.version == interp->global_version) {
+        return ref->data.global.binding->value;
+    }
+    return global_ref_miss(ref, env);
+}
+
+// Primitive function wrappers for eval. Arguments arrive as an array on
+// the argument stack, already checked against the arity the primitive was
+// registered with; ARG() reads nil past the end for optional ones.
+#define ARG(i) ((i) < argc ? argv[i] : nil())
+
+// Left fold of a binary arithmetic function over argv, stopping at the
+// first error. No arguments give the identity and one gives (op identity a),
+// so (- a) negates and (/ a) is 1/a.
+static Sexp* fold_numbers(Sexp* (*op)(Sexp*, Sexp*), Sexp* identity, int argc, Sexp** argv) {
+    if (argc == 0) return identity;
+    if (argc == 1) return op(identity, argv[0]);
+    Sexp* acc = argv[0];
+    for (int i = 1; i < argc; i++) {
+        acc = op(acc, argv[i]);
+        if (!isNumber(acc)) break;
+    }
+    return acc;
+}
+
+// (< a b c ...) holds when every neighbouring pair does
+static Sexp* compare_chain(Sexp* (*op)(Sexp*, Sexp*), int argc, Sexp** argv) {
+    if (argc == 1 && !isNumber(argv[0])) {
+        return make_symbol("ERROR:NOT_A_NUMBER");
+    }
+    for (int i = 0; i + 1 < argc; i++) {
+        Sexp* result = op(argv[i], argv[i + 1]);
+        if (result != true_sexp()) return result;  // nil or an error
+    }
+    return true_sexp();
+}
+
+// The argument that compares as `want` (1 for max, -1 for min) against
+// all the others
+static Sexp* pick_number(int want, int argc, Sexp** argv) {
+    Sexp* best = argv[0];
+    if (!isNumber(best)) {
+        return make_symbol("ERROR:NOT_A_NUMBER");
+    }
+    for (int i = 1; i < argc; i++) {
+        int order = num_compare(argv[i], best);
+        if (order == ORDER_NOT_A_NUMBER) {
+            return make_symbol("ERROR:NOT_A_NUMBER");
+        }
+        if (order == want) best = argv[i];
+    }
+    return best;
+}
+
+Sexp* prim_add(int argc, Sexp** argv, Sexp* env) {
+    (void)env;
+    return fold_numbers(add, make_integer(0), argc, argv);
+}
+
+Sexp* prim_sub(int argc, Sexp** argv, Sexp* env) {
+    (void)env;
+    return fold_numbers(sub, make_integer(0), argc, argv);
+}
+
+Sexp* prim_mul(int argc, Sexp** argv, Sexp* env) {
+    (void)env;
+    return fold_numbers(mul, make_integer(1), argc, argv);
+}
+
+Sexp* prim_div(int argc, Sexp** argv, Sexp* env) {
+    (void)env;
+    return fold_numbers(divide, make_integer(1), argc, argv);
+}
+
+Sexp* prim_mod(int argc, Sexp** argv, Sexp* env) {
+    (void)env;
+    return mod(ARG(0), ARG(1));
+}
+
+Sexp* prim_lt(int argc, Sexp** argv, Sexp* env) {
+    (void)env;
+    return compare_chain(lt, argc, argv);
+}
+
+Sexp* prim_gt(int argc, Sexp** argv, Sexp* env) {
+    (void)env;
+    return compare_chain(gt, argc, argv);
+}
+
+Sexp* prim_lte(int argc, Sexp** argv, Sexp* env) {
+    (void)env;
+    return compare_chain(lte, argc, argv);
+}
+
+Sexp* prim_gte(int argc, Sexp** argv, Sexp* env) {
+    (void)env;
+    return compare_chain(gte, argc, argv);
+}
+
+Sexp* prim_max(int argc, Sexp** argv, Sexp* env) {
+    (void)env;
+    return pick_number(1, argc, argv);
+}
+
+Sexp* prim_min(int argc, Sexp** argv, Sexp* env) {
+    (void)env;
+    return pick_number(-1, argc, argv);
+}
+
+Sexp* prim_eq(int argc, Sexp** argv, Sexp* env) {
+    (void)env;
+    return eq(ARG(0), ARG(1)) ? true_sexp() : nil();
+}
+
+Sexp* prim_not(int argc, Sexp** argv, Sexp* env) {
+    (void)env;
+    return not(ARG(0));
+}
+
+Sexp* prim_cons(int argc, Sexp** argv, Sexp* env) {
+    (void)env;
+    return cons(ARG(0), ARG(1));
+}
+
+Sexp* prim_car(int argc, Sexp** argv, Sexp* env) {
+    (void)env;
+    return car(ARG(0));
+}
+
+Sexp* prim_cdr(int argc, Sexp** argv, Sexp* env) {
+    (void)env;
+    return cdr(ARG(0));
+}
+
+Sexp* prim_gc(int argc, Sexp** argv, Sexp* env) {
+    (void)argc;
+    (void)argv;
+    (void)env;
+    gc_collect();
+    return make_integer((int64_t)gc_live_cells());
+}
+
+static bool isFunction(Sexp* s) {
+    return isLambda(s) || isPrimitive(s);
+}
+
+Sexp* prim_length(int argc, Sexp** argv, Sexp* env) {
+    (void)argc;
+    (void)env;
+    if (!isList(argv[0])) return make_symbol("ERROR:NOT_A_LIST");
+    return make_integer(length(argv[0]));
+}
+
+Sexp* prim_reverse(int argc, Sexp** argv, Sexp* env) {
+    (void)argc;
+    (void)env;
+    if (!isList(argv[0])) return make_symbol("ERROR:NOT_A_LIST");
+    return reverse(argv[0]);
+}
+
+// (append a b c) copies a and b and shares c. Working from the right
+// copies each list once.
+Sexp* prim_append(int argc, Sexp** argv, Sexp* env) {
+    (void)env;
+    if (argc == 0) return nil();
+    for (int i = 0; i < argc - 1; i++) {
+        if (!isList(argv[i])) return make_symbol("ERROR:NOT_A_LIST");
+    }
+    Sexp* result = argv[argc - 1];
+    for (int i = argc - 2; i >= 0; i--) {
+        result = append(argv[i], result);
+    }
+    return result;
+}
+
+Sexp* prim_nth(int argc, Sexp** argv, Sexp* env) {
+    (void)argc;
+    (void)env;
+    if (!isInteger(argv[0])) return make_symbol("ERROR:NOT_A_NUMBER");
+    if (!isList(argv[1])) return make_symbol("ERROR:NOT_A_LIST");
+    return nth(sexp_integer(argv[0]), argv[1]);
+}
+
+Sexp* prim_assoc(int argc, Sexp** argv, Sexp* env) {
+    (void)argc;
+    (void)env;
+    return assoc(argv[0], argv[1]);
+}
+
+Sexp* prim_member(int argc, Sexp** argv, Sexp* env) {
+    (void)argc;
+    (void)env;
+    return member(argv[0], argv[1]);
+}
+
+// The higher-order wrappers copy their arguments out of argv before
+// calling back, since the callback may move the argument stack
+Sexp* prim_map(int argc, Sexp** argv, Sexp* env) {
+    (void)argc;
+    Sexp* func = argv[0];
+    Sexp* list = argv[1];
+    if (!isFunction(func)) return make_symbol("ERROR:NOT_A_FUNCTION");
+    if (!isList(list)) return make_symbol("ERROR:NOT_A_LIST");
+    return map_list(func, list, env);
+}
+
+Sexp* prim_filter(int argc, Sexp** argv, Sexp* env) {
+    (void)argc;
+    Sexp* func = argv[0];
+    Sexp* list = argv[1];
+    if (!isFunction(func)) return make_symbol("ERROR:NOT_A_FUNCTION");
+    if (!isList(list)) return make_symbol("ERROR:NOT_A_LIST");
+    return filter_list(func, list, env);
+}
+
+// (fold f init list)
+Sexp* prim_fold(int argc, Sexp** argv, Sexp* env) {
+    (void)argc;
+    Sexp* func = argv[0];
+    Sexp* init = argv[1];
+    Sexp* list = argv[2];
+    if (!isFunction(func)) return make_symbol("ERROR:NOT_A_FUNCTION");
+    if (!isList(list)) return make_symbol("ERROR:NOT_A_LIST");
+    return fold_list(func, init, list, env);
+}
+
+// (reduce f list): fold with the first element as the initial value
+Sexp* prim_reduce(int argc, Sexp** argv, Sexp* env) {
+    (void)argc;
+    Sexp* func = argv[0];
+    Sexp* list = argv[1];
+    if (!isFunction(func)) return make_symbol("ERROR:NOT_A_FUNCTION");
+    if (!isList(list)) return make_symbol("ERROR:NOT_A_LIST");
+    if (isNil(list)) return nil();
+    return fold_list(func, car(list), cdr(list), env);
+}
+
+// Defined with the resolver (LEXICAL ADDRESSING)
+Sexp* prim_expand(int argc, Sexp** argv, Sexp* env);
+
+// Defined with the thread pool (PARALLEL EVALUATION)
+Sexp* prim_pmap(int argc, Sexp** argv, Sexp* env);
+Sexp* prim_future_call(int argc, Sexp** argv, Sexp* env);
+Sexp* prim_touch(int argc, Sexp** argv, Sexp* env);
+
+void init_global_env() {
+    GLOBAL_ENV = make_table_env(nil());
+    true_sexp();
+    
+    // Tag the special-form symbols so eval can dispatch on them directly
+    intern("quote")->form = FORM_QUOTE;
+    intern("set")->form = FORM_SET;
+    intern("define")->form = FORM_DEFINE;
+    intern("lambda")->form = FORM_LAMBDA;
+    intern("if")->form = FORM_IF;
+    intern("and")->form = FORM_AND;
+    intern("or")->form = FORM_OR;
+    intern("cond")->form = FORM_COND;
+    intern("begin")->form = FORM_BEGIN;
+    intern("let")->form = FORM_LET;
+    intern("let*")->form = FORM_LET_STAR;
+    intern("letrec")->form = FORM_LETREC;
+    intern("while")->form = FORM_WHILE;
+    intern("do")->form = FORM_DO;
+    intern("future")->form = FORM_FUTURE;
+    
+    // Add primitive functions with their (min, max) argument counts
+    env_set(GLOBAL_ENV, intern("+"), make_primitive_arity(prim_add, 0, ARITY_VARIADIC));
+    env_set(GLOBAL_ENV, intern("-"), make_primitive_arity(prim_sub, 1, ARITY_VARIADIC));
+    env_set(GLOBAL_ENV, intern("*"), make_primitive_arity(prim_mul, 0, ARITY_VARIADIC));
+    env_set(GLOBAL_ENV, intern("/"), make_primitive_arity(prim_div, 1, ARITY_VARIADIC));
+    env_set(GLOBAL_ENV, intern("%"), make_primitive_arity(prim_mod, 2, 2));
+    env_set(GLOBAL_ENV, intern("<"), make_primitive_arity(prim_lt, 1, ARITY_VARIADIC));
+    env_set(GLOBAL_ENV, intern(">"), make_primitive_arity(prim_gt, 1, ARITY_VARIADIC));
+    env_set(GLOBAL_ENV, intern("<="), make_primitive_arity(prim_lte, 1, ARITY_VARIADIC));
+    env_set(GLOBAL_ENV, intern(">="), make_primitive_arity(prim_gte, 1, ARITY_VARIADIC));
+    env_set(GLOBAL_ENV, intern("max"), make_primitive_arity(prim_max, 1, ARITY_VARIADIC));
+    env_set(GLOBAL_ENV, intern("min"), make_primitive_arity(prim_min, 1, ARITY_VARIADIC));
+    env_set(GLOBAL_ENV, intern("eq"), make_primitive_arity(prim_eq, 2, 2));
+    env_set(GLOBAL_ENV, intern("not"), make_primitive_arity(prim_not, 1, 1));
+    env_set(GLOBAL_ENV, intern("cons"), make_primitive_arity(prim_cons, 2, 2));
+    env_set(GLOBAL_ENV, intern("car"), make_primitive_arity(prim_car, 1, 1));
+    env_set(GLOBAL_ENV, intern("cdr"), make_primitive_arity(prim_cdr, 1, 1));
+    env_set(GLOBAL_ENV, intern("gc"), make_primitive_arity(prim_gc, 0, 0));
+    env_set(GLOBAL_ENV, intern("expand"), make_primitive_arity(prim_expand, 1, 1));
+
+    // List library
+    env_set(GLOBAL_ENV, intern("length"), make_primitive_arity(prim_length, 1, 1));
+    env_set(GLOBAL_ENV, intern("reverse"), make_primitive_arity(prim_reverse, 1, 1));
+    env_set(GLOBAL_ENV, intern("append"), make_primitive_arity(prim_append, 0, ARITY_VARIADIC));
+    env_set(GLOBAL_ENV, intern("nth"), make_primitive_arity(prim_nth, 2, 2));
+    env_set(GLOBAL_ENV, intern("assoc"), make_primitive_arity(prim_assoc, 2, 2));
+    env_set(GLOBAL_ENV, intern("member"), make_primitive_arity(prim_member, 2, 2));
+    env_set(GLOBAL_ENV, intern("map"), make_primitive_arity(prim_map, 2, 2));
+    env_set(GLOBAL_ENV, intern("filter"), make_primitive_arity(prim_filter, 2, 2));
+    env_set(GLOBAL_ENV, intern("fold"), make_primitive_arity(prim_fold, 3, 3));
+    env_set(GLOBAL_ENV, intern("reduce"), make_primitive_arity(prim_reduce, 2, 2));
+    env_set(GLOBAL_ENV, intern("pmap"), make_primitive_arity(prim_pmap, 2, 2));
+    env_set(GLOBAL_ENV, intern("future-call"), make_primitive_arity(prim_future_call, 1, 1));
+    env_set(GLOBAL_ENV, intern("touch"), make_primitive_arity(prim_touch, 1, 1));
+    
+    // Alternative names
+    env_set(GLOBAL_ENV, intern("add"), env_lookup(GLOBAL_ENV, intern("+")));
+    env_set(GLOBAL_ENV, intern("sub"), env_lookup(GLOBAL_ENV, intern("-")));
+    env_set(GLOBAL_ENV, intern("mul"), env_lookup(GLOBAL_ENV, intern("*")));
+    env_set(GLOBAL_ENV, intern("div"), env_lookup(GLOBAL_ENV, intern("/")));
+    env_set(GLOBAL_ENV, intern("mod"), env_lookup(GLOBAL_ENV, intern("%")));
+}
+
+// ============================================================================
+// LEXICAL ADDRESSING
+// ============================================================================
+
+// When a lambda is created its body is rewritten once. References to
+// parameters, and to locals introduced by set/define, become LOCAL_REF cells
+// holding (frame depth, slot index). Nested lambda forms become PROTO cells
+// resolved against the enclosing scopes, and (define f (x) ...) becomes a set
+// of the new closure. Each call then gets a FRAME whose slots are a plain
+// array, so reading a local is a few pointer hops instead of a name search.
+//
+// Names bound in none of the resolved frames become GLOBAL_REF cells, which
+// cache the global binding they find the first time they run.
+//
+// set and define bind in the innermost frame, as before, so their targets
+// get slots of their own. Until such a slot is assigned, a reference to it
+// falls back to whatever the name means in the enclosing scope.
+//
+// let, let* and letrec become (let PROTO init...): the PROTO describes one
+// frame holding all the bound variables, with the body resolved inside it,
+// and the inits are resolved in the scope they run in. A let frame is not a
+// call frame, so set/define inside it still bind in the enclosing lambda's
+// frame unless they name one of the let's own variables.
+
+typedef struct Scope {
+    Sexp** names;        // Slot names; NULL where a name isn't known
+    int count;
+    int capacity;
+    int arity;
+    struct Scope* parent;
+} Scope;
+
+// Placeholder held by local slots that set/define haven't assigned yet
+static Sexp unbound_marker = { ATOM_SYMBOL, true, FORM_NONE, { .symbol = (char*)"UNDEFINED" } };
+#define UNBOUND (&unbound_marker)
+
+static void scope_add(Scope* scope, Sexp* name) {
+    if (scope->count == scope->capacity) {
+        int capacity = scope->capacity ? scope->capacity * 2 : 8;
+        Sexp** grown = (Sexp**)realloc(scope->names, capacity * sizeof(Sexp*));
+        if (!grown) out_of_memory();
+        scope->names = grown;
+        scope->capacity = capacity;
+    }
+    scope->names[scope->count++] = name;
+}
+
+static void scope_declare(Scope* scope, Sexp* name) {
+    for (int i = 0; i < scope->count; i++) {
+        if (scope->names[i] == name) return;
+    }
+    scope_add(scope, name);
+}
+
+// Rebuild the static scopes of the frames a lambda is being created in.
+// Resolution stops at the global frame or at a make_env() frame, whose
+// bindings can change shape at run time; names past that point are left
+// as symbols and looked up by name.
+static Scope* scope_from_env(Sexp* env) {
+    if (isNil(env) || sexp_type(env) != FRAME_TYPE) return NULL;
+
+    Sexp* proto = env->data.frame.proto;
+    Scope* scope = (Scope*)calloc(1, sizeof(Scope));
+    if (!scope) out_of_memory();
+    for (Sexp* p = proto->data.proto.params; p && sexp_type(p) == CONS_CELL; p = cdr(p)) {
+        scope_add(scope, car(p));
+    }
+    scope->arity = scope->count;
+    while (scope->count < proto->data.proto.info->nslots) {
+        scope_add(scope, NULL);
+    }
+    scope->parent = scope_from_env(env->data.frame.parent);
+    return scope;
+}
+
+static void scope_free_chain(Scope* scope) {
+    while (scope) {
+        Scope* parent = scope->parent;
+        free(scope->names);
+        free(scope);
+        scope = parent;
+    }
+}
+
+static Sexp* make_local_ref(Sexp* symbol, Sexp* fallback, int depth, int index) {
+    Sexp* s = allocate_sexp();
+    s->type = LOCAL_REF;
+    s->data.ref.symbol = symbol;
+    s->data.ref.fallback = fallback;
+    s->data.ref.depth = depth;
+    s->data.ref.index = index;
+    return s;
+}
+
+static Sexp* make_global_ref(Sexp* symbol) {
+    Sexp* s = allocate_sexp();
+    s->type = GLOBAL_REF;
+    s->data.global.symbol = symbol;
+    s->data.global.binding = NULL;
+    s->data.global.version = 0;  // Never current: the first use fills it
+    return s;
+}
+
+static Sexp* resolve_reference(Sexp* symbol, Scope* scope, int depth);
+
+// A set/define target: a LOCAL_REF, or the symbol itself if it's free
+static Sexp* resolve_symbol(Sexp* symbol, Scope* scope, int depth) {
+    for (; scope; scope = scope->parent, depth++) {
+        for (int i = 0; i < scope->count; i++) {
+            if (scope->names[i] == symbol) {
+                Sexp* fallback = NULL;
+                if (i >= scope->arity) {
+                    fallback = resolve_reference(symbol, scope->parent, depth + 1);
+                }
+                return make_local_ref(symbol, fallback, depth, i);
+            }
+        }
+    }
+    return symbol;
+}
+
+// A name being read: free names get a GLOBAL_REF
+static Sexp* resolve_reference(Sexp* symbol, Scope* scope, int depth) {
+    Sexp* ref = resolve_symbol(symbol, scope, depth);
+    return ref == symbol ? make_global_ref(symbol) : ref;
+}
+
+// Find the names that set/define bind in this body, without entering
+// quoted data or nested lambda bodies
+static void collect_locals(Sexp* form, Scope* scope) {
+    if (!form || sexp_type(form) != CONS_CELL) return;
+
+    Sexp* head = car(form);
+    if (isSymbol(head)) {
+        switch (symbol_form(head)) {
+            case FORM_QUOTE:
+            case FORM_LAMBDA:
+                return;
+            case FORM_DEFINE:
+                if (isSymbol(cadr(form))) scope_declare(scope, cadr(form));
+                return;
+            case FORM_SET:
+                if (isSymbol(cadr(form))) scope_declare(scope, cadr(form));
+                collect_locals(caddr(form), scope);
+                return;
+            default:
+                break;
+        }
+    }
+    for (; form && sexp_type(form) == CONS_CELL; form = cdr(form)) {
+        collect_locals(car(form), scope);
+    }
+}
+
+static Sexp* make_proto_in_scope(Sexp* params, Sexp* body, Scope* parent);
+
+static Sexp* resolve(Sexp* form, Scope* scope);
+
+static Sexp* resolve_let(Sexp* form, Scope* outer);
+
+// The body of a lambda, define or let: one form as it is, several wrapped
+// in a begin
+static Sexp* make_body(Sexp* forms) {
+    if (sexp_is_cons(forms) && isNil(cdr(forms))) return car(forms);
+    if (isNil(forms)) return nil();
+    return cons(intern("begin"), forms);
+}
+
+// Temporaries for do loops stepping several variables at once. The leading
+// space keeps the reader from ever producing these names.
+static Sexp* do_temp(int i) {
+    char name[32];
+    snprintf(name, sizeof(name), " step%d", i);
+    return intern(name);
+}
+
+// (do ((var init step)...) (test result...) body...) becomes one let frame
+// and a while loop that assigns the steps in place:
+//
+//   (let ((var init)...) (while (if test () 'T) body... (set var step)...)
+//        result...)
+//
+// With more than one step, every step is computed into a temporary slot
+// first, so each sees the previous iteration's values.
+static Sexp* expand_do(Sexp* form) {
+    Sexp* specs = cadr(form);
+    Sexp* clause = caddr(form);
+
+    Sexp* bindings = nil();
+    Sexp* steps = nil();       // (var . step) pairs, in order
+    int nsteps = 0;
+    for (Sexp* p = specs; sexp_is_cons(p); p = cdr(p)) {
+        Sexp* spec = car(p);
+        bindings = cons(list2(car(spec), cadr(spec)), bindings);
+        if (sexp_is_cons(cddr(spec))) {
+            steps = cons(cons(car(spec), caddr(spec)), steps);
+            nsteps++;
+        }
+    }
+
+    // Built back to front: the step sets go at the end of the loop body
+    Sexp* loop = nil();
+    int i = nsteps;
+    for (Sexp* p = steps; sexp_is_cons(p); p = cdr(p)) {
+        Sexp* var = car(car(p));
+        Sexp* step = cdr(car(p));
+        i--;
+        if (nsteps == 1) {
+            loop = cons(list3(intern("set"), var, step), loop);
+        } else {
+            loop = cons(list3(intern("set"), var, do_temp(i)), loop);
+        }
+    }
+    if (nsteps > 1) {
+        i = nsteps;
+        for (Sexp* p = steps; sexp_is_cons(p); p = cdr(p)) {
+            i--;
+            loop = cons(list3(intern("set"), do_temp(i), cdr(car(p))), loop);
+            bindings = cons(list2(do_temp(i), nil()), bindings);
+        }
+    }
+    Sexp* body = cddr(form);
+    loop = append(sexp_is_cons(body) ? cdr(body) : nil(), loop);
+
+    Sexp* test = list4(intern("if"), car(clause), nil(), list2(intern("quote"), true_sexp()));
+    Sexp* whole = cons(intern("while"), cons(test, loop));
+    return cons(intern("let"), cons(reverse(bindings), cons(whole, cdr(clause))));
+}
+
+// (future body...) becomes (future-call (lambda () body...)), so each
+// engine only needs to make the closure (see PARALLEL EVALUATION)
+static Sexp* expand_future(Sexp* form) {
+    return list2(intern("future-call"), cons(intern("lambda"), cons(nil(), cdr(form))));
+}
+
+static Sexp* resolve_list(Sexp* list, Scope* scope) {
+    Sexp* head = nil();
+    Sexp* tail = nil();
+    for (; list && sexp_type(list) == CONS_CELL; list = cdr(list)) {
+        Sexp* cell = cons(resolve(car(list), scope), nil());
+        if (isNil(head)) {
+            head = cell;
+        } else {
+            sexp_cons(tail)->cdr = cell;
+        }
+        tail = cell;
+    }
+    if (!isNil(list) && !isNil(tail)) {
+        sexp_cons(tail)->cdr = list;  // Keep an improper tail as it was
+    }
+    return head;
+}
+
+static Sexp* resolve(Sexp* form, Scope* scope) {
+    if (isSymbol(form)) {
+        return resolve_reference(form, scope, 0);
+    }
+    if (!form || sexp_type(form) != CONS_CELL) {
+        return form;
+    }
+
+    Sexp* head = car(form);
+    if (isSymbol(head)) {
+        switch (symbol_form(head)) {
+            case FORM_QUOTE:
+                return form;
+            case FORM_LAMBDA:
+                return make_proto_in_scope(cadr(form), make_body(cddr(form)), scope);
+            case FORM_DEFINE: {
+                Sexp* target = resolve_symbol(cadr(form), scope, 0);
+                Sexp* proto = make_proto_in_scope(caddr(form), make_body(cdddr(form)), scope);
+                return list3(intern("set"), target, proto);
+            }
+            case FORM_SET: {
+                Sexp* target = resolve_symbol(cadr(form), scope, 0);
+                return list3(head, target, resolve(caddr(form), scope));
+            }
+            case FORM_LET:
+            case FORM_LET_STAR:
+            case FORM_LETREC:
+                return resolve_let(form, scope);
+            case FORM_DO:
+                return resolve(expand_do(form), scope);
+            case FORM_FUTURE:
+                return resolve(expand_future(form), scope);
+            case FORM_NONE:
+                break;
+            default:
+                // if/and/or/cond/begin/while: keep the keyword, resolve the
+                // operands
+                return cons(head, resolve_list(cdr(form), scope));
+        }
+    }
+    return resolve_list(form, scope);
+}
+
+// Escape analysis: true if running form could create a closure, which
+// might then hold on to the frame form runs in. Resolved lambdas show up as
+// PROTO cells; a let's PROTO only counts if its own frames can be captured.
+static bool may_capture(Sexp* form) {
+    if (!form) return false;
+    if (sexp_type(form) == PROTO_TYPE) return true;
+    if (sexp_type(form) == FOLD_GUARD) {
+        return may_capture(form->data.guard.folded) || may_capture(form->data.guard.original);
+    }
+    if (sexp_type(form) != CONS_CELL) return false;
+
+    Sexp* head = car(form);
+    if (isSymbol(head)) {
+        switch (symbol_form(head)) {
+            case FORM_QUOTE:
+                return false;
+            case FORM_LET:
+            case FORM_LET_STAR:
+            case FORM_LETREC:
+                if (sexp_type(cadr(form)) == PROTO_TYPE) {
+                    if (!cadr(form)->data.proto.info->stack_frames) return true;
+                    form = cddr(form);  // Just the inits are left
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    for (; sexp_type(form) == CONS_CELL; form = cdr(form)) {
+        if (may_capture(car(form))) return true;
+    }
+    return false;
+}
+
+// Constant folding. Each resolved body is simplified once, when its lambda
+// or let is created: calls of pure builtins on constant arguments are
+// replaced by their result, if and cond drop branches whose tests are
+// constant, and a lambda with nothing but parameters applied directly to
+// constants is inlined. Builtins are matched by the function a name is
+// bound to at that moment, and every simplification that relied on one is
+// kept in a FOLD_GUARD cell with the form it replaced. The engines run the
+// folded form while the names it assumed are still bound to those
+// builtins, and the original once one has been rebound, so rebinding +
+// later behaves as it would without folding.
+
+// resolve_env is the environment free names in the body being resolved
+// are looked up in.
+
+// Builtins with no side effects that return the same result for the same
+// arguments. cons, append and friends are left out: each call must return
+// fresh cells.
+static const PrimitiveFunc pure_primitives[] = {
+    prim_add, prim_sub, prim_mul, prim_div, prim_mod,
+    prim_lt, prim_gt, prim_lte, prim_gte, prim_max, prim_min,
+    prim_eq, prim_not, prim_car, prim_cdr,
+    prim_length, prim_nth, prim_assoc, prim_member,
+};
+#define PURE_PRIMITIVE_COUNT (int)(sizeof(pure_primitives) / sizeof(pure_primitives[0]))
+
+// Folding calls with more arguments than this isn't worth a bigger buffer
+#define FOLD_MAX_ARGS 16
+
+static bool is_constant(Sexp* form) {
+    if (isNil(form) || isNumber(form) || isString(form)) return true;
+    return sexp_is_cons(form) && isSymbol(car(form)) && symbol_form(car(form)) == FORM_QUOTE;
+}
+
+static Sexp* constant_value(Sexp* form) {
+    return sexp_is_cons(form) ? cadr(form) : form;
+}
+
+// A form evaluating to value
+static Sexp* constant_form(Sexp* value) {
+    if (isNil(value) || isNumber(value) || isString(value)) return value;
+    return list2(intern("quote"), value);
+}
+
+static bool is_error(Sexp* s) {
+    return isSymbol(s) && strncmp(symbol_name(s), "ERROR:", 6) == 0;
+}
+
+static Sexp* make_guard(Sexp* folded, Sexp* original, Sexp* assumed) {
+    Sexp* s = allocate_sexp();
+    s->type = FOLD_GUARD;
+    s->data.guard.folded = folded;
+    s->data.guard.original = original;
+    s->data.guard.assumed = assumed;
+    return s;
+}
+
+// True while every name guard assumed is bound to the same builtin: one
+// cached lookup and compare each, as OP_PRIM does
+static bool guard_holds(Sexp* guard, Sexp* env) {
+    for (Sexp* a = guard->data.guard.assumed; sexp_is_cons(a); a = cdr(a)) {
+        if (global_ref_value(car(car(a)), env) != cdr(car(a))) return false;
+    }
+    return true;
+}
+
+// What form simplified to, seen through a guard
+static Sexp* folded_form(Sexp* form) {
+    return sexp_type(form) == FOLD_GUARD ? form->data.guard.folded : form;
+}
+
+static bool folds_to_constant(Sexp* form) {
+    return is_constant(folded_form(form));
+}
+
+// assumed with those of form added, if form is a guard
+static Sexp* add_assumed(Sexp* assumed, Sexp* form) {
+    if (sexp_type(form) != FOLD_GUARD) return assumed;
+    for (Sexp* a = form->data.guard.assumed; sexp_is_cons(a); a = cdr(a)) {
+        Sexp* symbol = car(car(a))->data.global.symbol;
+        bool known = false;
+        for (Sexp* b = assumed; sexp_is_cons(b) && !known; b = cdr(b)) {
+            known = car(car(b))->data.global.symbol == symbol;
+        }
+        if (!known) assumed = cons(car(a), assumed);
+    }
+    return assumed;
+}
+
+// The pure builtin a free name is bound to now, if any
+static Sexp* fold_primitive(Sexp* ref) {
+    Sexp* env = interp->resolve_env;
+    while (sexp_type(env) == FRAME_TYPE) {
+        env = env->data.frame.parent;
+    }
+    if (sexp_type(env) != ENV_TYPE) return NULL;
+    Sexp* func = table_find(env->data.env.table, ref->data.global.symbol)->value;
+    if (!func || !isPrimitive(func)) return NULL;
+    for (int i = 0; i < PURE_PRIMITIVE_COUNT; i++) {
+        if (func->data.primitive.func == pure_primitives[i]) return func;
+    }
+    return NULL;
+}
+
+// True if form only reads the parameters of the frame it runs in, so it
+// can run in the caller's frame once they are substituted
+static bool inlinable(Sexp* form) {
+    if (sexp_type(form) == LOCAL_REF) return form->data.ref.depth == 0;
+    if (sexp_type(form) == PROTO_TYPE) return false;
+    if (sexp_type(form) == FOLD_GUARD) {
+        return inlinable(form->data.guard.folded) && inlinable(form->data.guard.original);
+    }
+    if (!sexp_is_cons(form)) return true;
+
+    Sexp* head = car(form);
+    if (isSymbol(head)) {
+        switch (symbol_form(head)) {
+            case FORM_QUOTE:
+                return true;
+            case FORM_IF:
+            case FORM_AND:
+            case FORM_OR:
+            case FORM_COND:
+            case FORM_BEGIN:
+            case FORM_NONE:
+                break;
+            default:
+                return false;  // set, let, while: they need a frame
+        }
+    }
+    for (; sexp_is_cons(form); form = cdr(form)) {
+        if (!inlinable(car(form))) return false;
+    }
+    return true;
+}
+
+// Copy of form with parameter references replaced by the argument forms
+static Sexp* substitute(Sexp* form, Sexp** args) {
+    if (sexp_type(form) == LOCAL_REF) return args[form->data.ref.index];
+    if (sexp_type(form) == FOLD_GUARD) {
+        return make_guard(substitute(form->data.guard.folded, args),
+                          substitute(form->data.guard.original, args),
+                          form->data.guard.assumed);
+    }
+    if (!sexp_is_cons(form) || is_constant(form)) return form;
+    return cons(substitute(car(form), args), substitute(cdr(form), args));
+}
+
+static Sexp* fold(Sexp* form);
+
+// Fold each element of a resolved list in place
+static void fold_each(Sexp* list) {
+    for (; sexp_is_cons(list); list = cdr(list)) {
+        sexp_cons(list)->car = fold(car(list));
+    }
+}
+
+// A call whose operands are already folded
+static Sexp* fold_call(Sexp* form) {
+    Sexp* head = car(form);
+    Sexp* args[FOLD_MAX_ARGS];
+    int argc = 0;
+    for (Sexp* a = cdr(form); sexp_is_cons(a); a = cdr(a)) {
+        if (argc == FOLD_MAX_ARGS || !folds_to_constant(car(a))) return form;
+        args[argc++] = car(a);
+    }
+
+    if (sexp_type(head) == PROTO_TYPE) {
+        ProtoInfo* info = head->data.proto.info;
+        Sexp* body = head->data.proto.body;
+        if (argc != info->arity || info->nslots != info->arity || !inlinable(body)) {
+            return form;
+        }
+        return fold(substitute(body, args));
+    }
+
+    if (sexp_type(head) != GLOBAL_REF) return form;
+    Sexp* func = fold_primitive(head);
+    if (!func) return form;
+    int max_args = func->data.primitive.max_args;
+    if (argc < func->data.primitive.min_args || (max_args != ARITY_VARIADIC && argc > max_args)) {
+        return form;
+    }
+    Sexp* assumed = list1(cons(head, func));
+    for (int i = 0; i < argc; i++) {
+        assumed = add_assumed(assumed, args[i]);
+        args[i] = constant_value(folded_form(args[i]));
+    }
+    // car and cdr of anything else complain on stderr, which must happen
+    // when the call runs, not when its lambda is made
+    PrimitiveFunc op = func->data.primitive.func;
+    if ((op == prim_car || op == prim_cdr) && !sexp_is_cons(args[0])) return form;
+    Sexp* result = func->data.primitive.func(argc, args, interp->resolve_env);
+    // Leave errors to happen at run time, where they are reported
+    return is_error(result) ? form : make_guard(constant_form(result), form, assumed);
+}
+
+// (if test then else) with a constant test is the branch it picks
+static Sexp* fold_if(Sexp* form) {
+    Sexp* test = cadr(form);
+    if (!folds_to_constant(test)) return form;
+    Sexp* branch;
+    if (isTrueSexp(constant_value(folded_form(test)))) branch = caddr(form);
+    else branch = sexp_is_cons(cdddr(form)) ? cadddr(form) : nil();
+    Sexp* assumed = add_assumed(nil(), test);
+    return isNil(assumed) ? branch : make_guard(branch, form, assumed);
+}
+
+// Clauses with a constant nil test go; one with a constant true test ends
+// the cond, or replaces it if it comes first
+static Sexp* fold_cond(Sexp* form) {
+    // Clauses are dropped from a copy; the cond as written stays the
+    // original of a guard if a folded test assumed some builtin
+    Sexp* original = form;
+    form = cons(car(form), cdr(form));
+    Sexp* assumed = nil();
+    Sexp* prev = form;
+    Sexp* result = NULL;
+    for (Sexp* c = cdr(form); sexp_is_cons(c); c = cdr(c)) {
+        Sexp* clause = car(c);
+        if (!sexp_is_cons(clause) || !folds_to_constant(car(clause))) {
+            sexp_cons(prev)->cdr = cons(clause, nil());
+            prev = cdr(prev);
+            continue;
+        }
+        assumed = add_assumed(assumed, car(clause));
+        if (!isTrueSexp(constant_value(folded_form(car(clause))))) {
+            continue;
+        }
+        if (prev == form) {
+            result = sexp_is_cons(cdr(clause)) ? cadr(clause) : nil();
+        } else {
+            sexp_cons(prev)->cdr = cons(clause, nil());
+        }
+        break;
+    }
+    if (!result) {
+        if (prev == form) sexp_cons(form)->cdr = nil();
+        result = isNil(cdr(form)) ? nil() : form;
+    }
+    return isNil(assumed) ? result : make_guard(result, original, assumed);
+}
+
+// Simplify a resolved form. Nested PROTO and let bodies were folded when
+// they were made.
+static Sexp* fold(Sexp* form) {
+    if (!sexp_is_cons(form)) return form;
+
+    Sexp* head = car(form);
+    if (isSymbol(head)) {
+        switch (symbol_form(head)) {
+            case FORM_QUOTE:
+                return form;
+            case FORM_IF:
+                fold_each(cdr(form));
+                return fold_if(form);
+            case FORM_COND:
+                // Clauses aren't calls: fold their parts one by one
+                for (Sexp* c = cdr(form); sexp_is_cons(c); c = cdr(c)) {
+                    fold_each(car(c));
+                }
+                return fold_cond(form);
+            case FORM_LET:
+            case FORM_LET_STAR:
+            case FORM_LETREC:
+                fold_each(cddr(form));
+                return form;
+            case FORM_SET:
+                fold_each(cddr(form));
+                return form;
+            case FORM_NONE:
+                break;
+            default:
+                fold_each(cdr(form));
+                return form;
+        }
+    }
+    fold_each(form);
+    return fold_call(form);
+}
+
+static Sexp* make_proto_cell(Sexp* params, Sexp* body, int arity, int nslots) {
+    ProtoInfo* info = (ProtoInfo*)calloc(1, sizeof(ProtoInfo));
+    if (!info) out_of_memory();
+    info->arity = arity;
+    info->nslots = nslots;
+
+    Sexp* s = allocate_sexp();
+    s->type = PROTO_TYPE;
+    s->data.proto.params = params;
+    s->data.proto.body = body;
+    s->data.proto.info = info;
+    page_of(s)->owners++;
+    return s;
+}
+
+static Sexp* make_proto_in_scope(Sexp* params, Sexp* body, Scope* parent) {
+    Scope scope = { NULL, 0, 0, 0, parent };
+    for (Sexp* p = params; p && sexp_type(p) == CONS_CELL; p = cdr(p)) {
+        scope_add(&scope, car(p));
+    }
+    scope.arity = scope.count;
+    collect_locals(body, &scope);
+
+    Sexp* resolved = fold(resolve(body, &scope));
+
+    Sexp* s = make_proto_cell(params, resolved, scope.arity, scope.count);
+    s->data.proto.info->stack_frames = !may_capture(resolved);
+    free(scope.names);
+    return s;
+}
+
+// Turn (let ((var init)...) body...) into (let PROTO init...). let inits
+// are resolved outside the new frame; let* inits each see the variables
+// before them, and letrec inits see all of them.
+static Sexp* resolve_let(Sexp* form, Scope* outer) {
+    Sexp* head = car(form);
+    SpecialForm kind = symbol_form(head);
+    Scope scope = { NULL, 0, 0, 0, outer };
+
+    Sexp* vars = nil();
+    Sexp* vars_tail = NULL;
+    for (Sexp* b = cadr(form); sexp_is_cons(b); b = cdr(b)) {
+        Sexp* cell = cons(car(car(b)), nil());
+        if (vars_tail) sexp_cons(vars_tail)->cdr = cell;
+        else vars = cell;
+        vars_tail = cell;
+        if (kind == FORM_LETREC) scope_add(&scope, car(car(b)));
+    }
+
+    Sexp* inits = nil();
+    Sexp* inits_tail = NULL;
+    for (Sexp* b = cadr(form); sexp_is_cons(b); b = cdr(b)) {
+        Sexp* init = resolve(cadr(car(b)), kind == FORM_LET ? outer : &scope);
+        Sexp* cell = cons(init, nil());
+        if (inits_tail) sexp_cons(inits_tail)->cdr = cell;
+        else inits = cell;
+        inits_tail = cell;
+        if (kind != FORM_LETREC) {
+            // A later let* binding of the same name hides the earlier one
+            Sexp* var = car(car(b));
+            for (int i = 0; i < scope.count; i++) {
+                if (scope.names[i] == var) scope.names[i] = NULL;
+            }
+            scope_add(&scope, var);
+        }
+    }
+    scope.arity = scope.count;
+
+    Sexp* body = fold(resolve(make_body(cddr(form)), &scope));
+    Sexp* proto = make_proto_cell(vars, body, scope.count, scope.count);
+    // let* and letrec inits run inside the frame too
+    bool captured = may_capture(body);
+    for (Sexp* i = inits; kind != FORM_LET && !captured && !isNil(i); i = cdr(i)) {
+        captured = may_capture(car(i));
+    }
+    proto->data.proto.info->stack_frames = !captured;
+    free(scope.names);
+    return cons(head, cons(proto, inits));
+}
+
+// Resolve a let met in unresolved (top-level) code against the frames of
+// the environment it runs in
+static Sexp* resolve_let_in_env(Sexp* form, Sexp* env) {
+    interp->resolve_env = env;
+    Scope* scope = scope_from_env(env);
+    Sexp* resolved = resolve_let(form, scope);
+    scope_free_chain(scope);
+    return resolved;
+}
+
+Sexp* make_proto(Sexp* params, Sexp* body, Sexp* env) {
+    interp->resolve_env = env;
+    Scope* parent = scope_from_env(env);
+    Sexp* proto = make_proto_in_scope(params, body, parent);
+    scope_free_chain(parent);
+    return proto;
+}
+
+// Turn a resolved form back into source: references become their names,
+// PROTOs lambdas and resolved lets their usual form again, and folded
+// forms whichever of their two versions would run now
+static Sexp* unresolve(Sexp* form) {
+    if (sexp_type(form) == LOCAL_REF) return form->data.ref.symbol;
+    if (sexp_type(form) == GLOBAL_REF) return form->data.global.symbol;
+    if (sexp_type(form) == FOLD_GUARD) {
+        return unresolve(guard_holds(form, GLOBAL_ENV) ? form->data.guard.folded
+                                                       : form->data.guard.original);
+    }
+    if (sexp_type(form) == PROTO_TYPE) {
+        return list3(intern("lambda"), form->data.proto.params, unresolve(form->data.proto.body));
+    }
+    if (!sexp_is_cons(form) || is_constant(form)) return form;
+
+    Sexp* head = car(form);
+    if (isSymbol(head) && sexp_type(cadr(form)) == PROTO_TYPE &&
+        (symbol_form(head) == FORM_LET || symbol_form(head) == FORM_LET_STAR ||
+         symbol_form(head) == FORM_LETREC)) {
+        Sexp* proto = cadr(form);
+        Sexp* bindings = nil();
+        Sexp* tail = NULL;
+        Sexp* init = cddr(form);
+        for (Sexp* v = proto->data.proto.params; sexp_is_cons(v); v = cdr(v), init = cdr(init)) {
+            Sexp* cell = cons(list2(car(v), unresolve(car(init))), nil());
+            if (tail) sexp_cons(tail)->cdr = cell;
+            else bindings = cell;
+            tail = cell;
+        }
+        return list3(head, bindings, unresolve(proto->data.proto.body));
+    }
+    return cons(unresolve(head), unresolve(cdr(form)));
+}
+
+// (expand f): f's body as it runs, after resolution and constant folding
+Sexp* prim_expand(int argc, Sexp** argv, Sexp* env) {
+    (void)argc;
+    (void)env;
+    Sexp* func = argv[0];
+    if (!isLambda(func)) return func;
+    Sexp* proto = func->data.lambda.proto;
+    return list3(intern("lambda"), proto->data.proto.params, unresolve(proto->data.proto.body));
+}
+
+// A new call frame for proto, with every slot unbound
+static Sexp* make_frame(Sexp* proto, Sexp* parent) {
+    int nslots = proto->data.proto.info->nslots;
+    if (proto->data.proto.info->stack_frames) {
+        // Popped by whoever called or entered it (see FRAME STACK)
+        Sexp* s = frame_stack_push(proto, parent);
+        for (int i = 0; i < nslots; i++) {
+            s->data.frame.slots[i] = UNBOUND;
+        }
+        return s;
+    }
+
+    Sexp** slots = (Sexp**)heap_alloc_bytes((nslots ? nslots : 1) * sizeof(Sexp*));
+    for (int i = 0; i < nslots; i++) {
+        slots[i] = UNBOUND;
+    }
+
+    Sexp* s = allocate_sexp();
+    s->type = FRAME_TYPE;
+    s->data.frame.slots = slots;
+    s->data.frame.parent = parent;
+    s->data.frame.proto = proto;
+    page_of(s)->owners++;
+    return s;
+}
+
+// A frame for a let PROTO. Its variables read nil until their inits have
+// run, which only letrec can observe.
+static Sexp* make_let_frame(Sexp* proto, Sexp* parent) {
+    Sexp* frame = make_frame(proto, parent);
+    for (int i = 0; i < proto->data.proto.info->nslots; i++) {
+        frame->data.frame.slots[i] = nil();
+    }
+    return frame;
+}
+
+static Sexp** local_slot(Sexp* ref, Sexp* env) {
+    for (int depth = ref->data.ref.depth; depth > 0; depth--) {
+        env = env->data.frame.parent;
+    }
+    return &env->data.frame.slots[ref->data.ref.index];
+}
+
+// ============================================================================
+// SPRINT 5-8: EVAL FUNCTION
+// ============================================================================
+
+// Calls evaluate their arguments onto this stack and hand primitives and
+// lambdas an (argc, argv) slice of it, so passing arguments allocates
+// nothing. The bytecode VM keeps its temporaries here too. The collector
+// marks everything below arg_top.
+
+static void gc_mark_arg_stack(void) {
+    for (size_t i = 0; i < interp->arg_top; i++) {
+        gc_mark(interp->arg_stack[i]);
+    }
+}
+
+static void arg_reserve(size_t needed) {
+    if (needed <= interp->arg_capacity) return;
+    size_t capacity = interp->arg_capacity ? interp->arg_capacity : 1024;
+    while (capacity < needed) capacity *= 2;
+    Sexp** grown = (Sexp**)realloc(interp->arg_stack, capacity * sizeof(Sexp*));
+    if (!grown) out_of_memory();
+    interp->arg_stack = grown;
+    interp->arg_capacity = capacity;
+}
+
+static void arg_push(Sexp* value) {
+    LOCAL_INTERP;
+    if (interp->arg_top == interp->arg_capacity) arg_reserve(interp->arg_top + 1);
+    interp->arg_stack[interp->arg_top++] = value;
+}
+
+// Lists are built front to back through a tail pointer, so the spine is
+// allocated in order and ends up contiguous in the cons slab
+Sexp* eval_list(Sexp* list, Sexp* env) {
+    Sexp* head = nil();
+    Sexp* tail = NULL;
+    for (; !isNil(list); list = cdr(list)) {
+        Sexp* cell = cons(eval(car(list), env), nil());
+        if (tail) sexp_cons(tail)->cdr = cell;
+        else head = cell;
+        tail = cell;
+    }
+    return head;
+}
+
+// Copy argv into a fresh frame for a lambda call. The frame's slot array
+// is the only copy; env_values() builds a list from it only if asked.
+static Sexp* bind_frame(Sexp* func, int argc, Sexp** argv) {
+    Sexp* proto = func->data.lambda.proto;
+    Sexp* frame = make_frame(proto, func->data.lambda.env);
+    for (int i = 0; i < proto->data.proto.info->arity; i++) {
+        frame->data.frame.slots[i] = i < argc ? argv[i] : nil();
+    }
+    return frame;
+}
+
+// Argument counts are checked here, once per call, so primitives can index
+// argv without probing
+static Sexp* call_primitive(Sexp* func, int argc, Sexp** argv, Sexp* env) {
+    int max_args = func->data.primitive.max_args;
+    if (argc < func->data.primitive.min_args || (max_args != ARITY_VARIADIC && argc > max_args)) {
+        return make_symbol("ERROR:WRONG_ARGUMENT_COUNT");
+    }
+    return func->data.primitive.func(argc, argv, env);
+}
+
+// Hot numeric lambdas may have native code (see JIT). jit_call() runs it
+// and returns true, or returns false and leaves the call to the engine.
+static bool jit_enter(Sexp* func, int argc, Sexp** argv, Sexp** result);
+
+static inline bool jit_call(Sexp* func, int argc, Sexp** argv, Sexp** result) {
+    return interp->jit_threshold && jit_enter(func, argc, argv, result);
+}
+
+Sexp* apply_argv(Sexp* func, int argc, Sexp** argv, Sexp* env) {
+    if (isPrimitive(func)) {
+        return call_primitive(func, argc, argv, env);
+    } else if (isLambda(func)) {
+        Sexp* result;
+        if (jit_call(func, argc, argv, &result)) return result;
+        FrameMark mark = frame_stack_mark();
+        Sexp* frame = bind_frame(func, argc, argv);
+        result = eval(func->data.lambda.proto->data.proto.body, frame);
+        frame_stack_release(mark);
+        return result;
+    }
+    return make_symbol("ERROR:NOT_A_FUNCTION");
+}
+
+Sexp* apply(Sexp* func, Sexp* args, Sexp* env) {
+    size_t base = interp->arg_top;
+    for (; !isNil(args); args = cdr(args)) {
+        arg_push(car(args));
+    }
+    Sexp* result = apply_argv(func, (int)(interp->arg_top - base), interp->arg_stack + base, env);
+    interp->arg_top = base;
+    return result;
+}
+
+// eval keeps its continuation on a heap stack rather than the C stack.
+// Each frame says what to do with the value being computed: pick an if
+// branch, test the next cond clause, store a set, or push an argument and
+// move on to the next one. Evaluating a subexpression pushes a frame and
+// loops; producing a value pops one. Non-tail recursion in Lisp therefore
+// grows this stack, not the C one, and only up to the configured depth.
+typedef enum {
+    K_ARGS,              // Push the value; evaluate the next operand or call
+    K_SET,               // Store the value in form (the target)
+    K_IF,
+    K_AND,
+    K_OR,
+    K_COND,              // form is the clause whose test is running
+    K_BEGIN,             // form is the forms after the running one
+    K_LET_SEQ,           // let*/letrec: store in slot base of env, go on
+    K_WHILE              // base is 0 while the test runs, 1 for the body
+} ContKind;
+
+typedef struct Cont {
+    ContKind kind;
+    Sexp* form;          // K_ARGS: operands still to evaluate
+    Sexp* env;
+    size_t base;         // K_ARGS: stack index of the function value (or
+                         // let PROTO)
+    FrameMark frames;    // Frame stack top when pushed
+} Cont;
+
+// Native code that calls back into Lisp (map, fold, ...) starts a new eval
+// or vm_run on the C stack; eval_nesting counts them, up to this
+#define EVAL_MAX_NESTING 2000
+
+// stack_overflowed is set when an eval or vm_run gives up for lack of
+// stack, or an allocation for lack of heap (heap_exhausted), so every run
+// it is nested in unwinds too, rather than carrying on with the error
+// value.
+
+void eval_configure(size_t max_depth) {
+    interp->eval_max_depth = max_depth;
+}
+
+static void gc_mark_eval_stack(void) {
+    for (size_t i = 0; i < interp->cont_top; i++) {
+        gc_mark(interp->cont_stack[i].form);
+        gc_mark(interp->cont_stack[i].env);
+    }
+}
+
+// True if a stack already holding depth entries may take one more
+static bool depth_available(size_t depth) {
+    return interp->eval_max_depth == 0 || depth < interp->eval_max_depth;
+}
+
+// Returns NULL at the depth limit, or if the stack can't grow
+static Cont* cont_push(ContKind kind, Sexp* form, Sexp* env) {
+    LOCAL_INTERP;
+    if (!depth_available(interp->cont_top)) return NULL;
+    if (interp->cont_top == interp->cont_capacity) {
+        size_t capacity = interp->cont_capacity ? interp->cont_capacity * 2 : 256;
+        Cont* grown = (Cont*)realloc(interp->cont_stack, capacity * sizeof(Cont));
+        if (!grown) return NULL;
+        interp->cont_stack = grown;
+        interp->cont_capacity = capacity;
+    }
+    Cont* k = &interp->cont_stack[interp->cont_top++];
+    k->kind = kind;
+    k->form = form;
+    k->env = env;
+    k->frames = frame_stack_mark();
+    return k;
+}
+
+// What every run returns while unwinding
+static Sexp* overflow_value(void) {
+    return make_symbol(interp->heap_exhausted ? "ERROR:OUT_OF_MEMORY" : "ERROR:STACK_OVERFLOW");
+}
+
+static Sexp* stack_overflow_error(void) {
+    interp->stack_overflowed = true;
+    return overflow_value();
+}
+
+// Leaving the outermost run clears the overflow, so the next form starts
+// clean
+static void leave_nesting(void) {
+    if (--interp->eval_nesting == 0) {
+        interp->stack_overflowed = false;
+        interp->heap_exhausted = false;
+    }
+}
+
+// Tail positions (if/cond branches, the last and/or operand, a lambda
+// body) replace sexp/env without pushing a frame, so tail-recursive Lisp
+// loops run in constant space.
+//
+// Stack-allocated call frames are popped when a value reaches a
+// continuation frame: anything pushed since that frame was made belongs to
+// calls that have finished. A tail call pops them before binding its own.
+Sexp* eval(Sexp* sexp, Sexp* env) {
+    LOCAL_INTERP;
+    size_t entry = interp->cont_top;
+    size_t entry_args = interp->arg_top;
+    FrameMark entry_frames = frame_stack_mark();
+    Sexp* value;
+    Cont* k;
+
+    if (interp->eval_nesting >= EVAL_MAX_NESTING) {
+        return stack_overflow_error();
+    }
+    interp->eval_nesting++;
+
+    while (1) {
+        // Handle nil
+        if (isNil(sexp)) {
+            value = nil();
+            goto deliver;
+        }
+    
+        // Handle numbers and strings - self-evaluating
+        if (isNumber(sexp) || isString(sexp)) {
+            value = sexp;
+            goto deliver;
+        }
+    
+        // Handle symbols - look up in environment
+        if (isSymbol(sexp)) {
+            value = env_lookup(env, sexp);
+            goto deliver;
+        }
+    
+        // Resolved local variables - read the slot directly
+        if (sexp_type(sexp) == LOCAL_REF) {
+            value = *local_slot(sexp, env);
+            if (value == UNBOUND) {
+                sexp = sexp->data.ref.fallback;
+                continue;
+            }
+            goto deliver;
+        }
+    
+        // Free names in a resolved body - through the reference's cache
+        if (sexp_type(sexp) == GLOBAL_REF) {
+            value = global_ref_value(sexp, env);
+            goto deliver;
+        }
+
+        // Folded forms - the original once a builtin folded is rebound
+        if (sexp_type(sexp) == FOLD_GUARD) {
+            sexp = guard_holds(sexp, env) ? sexp->data.guard.folded : sexp->data.guard.original;
+            continue;
+        }
+    
+        // Nested lambdas in a resolved body - close over the current frame
+        if (sexp_type(sexp) == PROTO_TYPE) {
+            value = make_closure(sexp, env);
+            goto deliver;
+        }
+    
+        if (!isList(sexp)) {
+            value = sexp;
+            goto deliver;
+        }
+
+        // Handle lists - function calls and special forms
+        Sexp* first = car(sexp);
+        
+        // Special forms - the head symbol carries its form tag, so this is
+        // a single switch rather than a chain of string compares
+        switch (isSymbol(first) ? symbol_form(first) : FORM_NONE) {
+            // QUOTE
+            case FORM_QUOTE:
+                value = cadr(sexp);
+                goto deliver;
+        
+            // SET
+            case FORM_SET:
+                if (!cont_push(K_SET, cadr(sexp), env)) goto overflow;
+                sexp = caddr(sexp);
+                continue;
+        
+            // DEFINE (Sprint 7)
+            case FORM_DEFINE: {
+                Sexp* name = cadr(sexp);
+                Sexp* params = caddr(sexp);
+                Sexp* body = make_body(cdddr(sexp));
+                Sexp* lambda = make_lambda(params, body, env);
+                value = env_set(env, name, lambda);
+                goto deliver;
+            }
+        
+            // LAMBDA (Sprint 8)
+            case FORM_LAMBDA: {
+                Sexp* params = cadr(sexp);
+                Sexp* body = make_body(cddr(sexp));
+                value = make_lambda(params, body, env);
+                goto deliver;
+            }
+        
+            // IF, AND, OR (Sprint 6): evaluate the test, decide in deliver
+            case FORM_IF:
+            case FORM_AND:
+            case FORM_OR: {
+                ContKind kind = symbol_form(first) == FORM_IF ? K_IF
+                              : symbol_form(first) == FORM_AND ? K_AND : K_OR;
+                if (!cont_push(kind, sexp, env)) goto overflow;
+                sexp = cadr(sexp);
+                continue;
+            }
+        
+            // COND (Sprint 6)
+            case FORM_COND: {
+                Sexp* clauses = cdr(sexp);
+                if (isNil(clauses)) {
+                    value = nil();
+                    goto deliver;
+                }
+                if (!cont_push(K_COND, clauses, env)) goto overflow;
+                sexp = car(car(clauses));
+                continue;
+            }
+        
+            // BEGIN: every form in turn, the last in tail position
+            case FORM_BEGIN: {
+                Sexp* forms = cdr(sexp);
+                if (isNil(forms)) {
+                    value = nil();
+                    goto deliver;
+                }
+                if (!isNil(cdr(forms))) {
+                    if (!cont_push(K_BEGIN, cdr(forms), env)) goto overflow;
+                }
+                sexp = car(forms);
+                continue;
+            }
+
+            // LET, LET*, LETREC: one frame for all the variables
+            case FORM_LET:
+            case FORM_LET_STAR:
+            case FORM_LETREC: {
+                if (sexp_type(cadr(sexp)) != PROTO_TYPE) {
+                    // Unresolved (top-level) code: resolve it here first
+                    sexp = resolve_let_in_env(sexp, env);
+                }
+                Sexp* proto = cadr(sexp);
+                Sexp* inits = cddr(sexp);
+                if (isNil(inits)) {
+                    env = make_let_frame(proto, env);
+                    sexp = proto->data.proto.body;
+                    continue;
+                }
+                if (symbol_form(first) == FORM_LET) {
+                    // Inits go on the argument stack above the PROTO, like
+                    // a call, and fill the frame when the last is done
+                    k = cont_push(K_ARGS, cdr(inits), env);
+                    if (!k) goto overflow;
+                    k->base = interp->arg_top;
+                    arg_push(proto);
+                } else {
+                    // Inits run inside the new frame, stored one by one
+                    env = make_let_frame(proto, env);
+                    k = cont_push(K_LET_SEQ, cdr(inits), env);
+                    if (!k) goto overflow;
+                    k->base = 0;
+                }
+                sexp = car(inits);
+                continue;
+            }
+
+            // WHILE: test, then body, until the test is nil
+            case FORM_WHILE:
+                k = cont_push(K_WHILE, sexp, env);
+                if (!k) goto overflow;
+                k->base = 0;
+                sexp = cadr(sexp);
+                continue;
+
+            // DO: rewritten into let and while
+            case FORM_DO:
+                sexp = expand_do(sexp);
+                continue;
+
+            // FUTURE: rewritten into a call of future-call
+            case FORM_FUTURE:
+                sexp = expand_future(sexp);
+                continue;
+        
+            default: {
+                // Regular function call - the function and then each
+                // argument are evaluated onto the argument stack
+                k = cont_push(K_ARGS, cdr(sexp), env);
+                if (!k) goto overflow;
+                k->base = interp->arg_top;
+                sexp = first;
+                continue;
+            }
+        }
+
+    deliver:
+        // Hand value to the innermost frame
+        if (interp->cont_top == entry) {
+            frame_stack_release(entry_frames);
+            leave_nesting();
+            return value;
+        }
+        k = &interp->cont_stack[interp->cont_top - 1];
+        frame_stack_release(k->frames);
+        env = k->env;
+        switch (k->kind) {
+            case K_SET: {
+                Sexp* symbol = k->form;
+                interp->cont_top--;
+                if (sexp_type(symbol) == LOCAL_REF) {
+                    *local_slot(symbol, env) = value;
+                } else {
+                    value = env_set(env, symbol, value);
+                }
+                goto deliver;
+            }
+
+            case K_IF:
+                interp->cont_top--;
+                sexp = isTrueSexp(value) ? caddr(k->form) : cadddr(k->form);
+                continue;
+
+            case K_AND:
+                interp->cont_top--;
+                if (isNil(value)) {
+                    value = nil();
+                    goto deliver;
+                }
+                sexp = caddr(k->form);
+                continue;
+
+            case K_OR:
+                interp->cont_top--;
+                if (!isNil(value)) {
+                    value = true_sexp();
+                    goto deliver;
+                }
+                sexp = caddr(k->form);
+                continue;
+
+            case K_COND:
+                if (isTrueSexp(value)) {
+                    interp->cont_top--;
+                    sexp = cadr(car(k->form));
+                    continue;
+                }
+                k->form = cdr(k->form);
+                if (isNil(k->form)) {
+                    interp->cont_top--;
+                    value = nil();  // No clause matched
+                    goto deliver;
+                }
+                sexp = car(car(k->form));
+                continue;
+
+            case K_BEGIN:
+                sexp = car(k->form);
+                k->form = cdr(k->form);
+                if (isNil(k->form)) {
+                    interp->cont_top--;  // The last form is a tail position
+                }
+                continue;
+
+            case K_LET_SEQ:
+                env->data.frame.slots[k->base++] = value;
+                if (isNil(k->form)) {
+                    interp->cont_top--;
+                    sexp = env->data.frame.proto->data.proto.body;
+                    continue;
+                }
+                sexp = car(k->form);
+                k->form = cdr(k->form);
+                continue;
+
+            case K_WHILE: {
+                Sexp* form = k->form;
+                if (k->base == 1) {
+                    // Body done, value dropped: test again
+                    k->base = 0;
+                    sexp = cadr(form);
+                    continue;
+                }
+                if (isNil(value)) {
+                    interp->cont_top--;
+                    value = nil();
+                    goto deliver;
+                }
+                Sexp* body = cddr(form);
+                if (isNil(body)) {
+                    sexp = cadr(form);
+                    continue;
+                }
+                k->base = 1;
+                if (!isNil(cdr(body))) {
+                    if (!cont_push(K_BEGIN, cdr(body), env)) goto overflow;
+                }
+                sexp = car(body);
+                continue;
+            }
+
+            case K_ARGS: {
+                arg_push(value);
+                if (!isNil(k->form)) {
+                    sexp = car(k->form);
+                    k->form = cdr(k->form);
+                    continue;
+                }
+                size_t base = k->base;
+                interp->cont_top--;
+                Sexp* func = interp->arg_stack[base];
+                int argc = (int)(interp->arg_top - base - 1);
+                if (sexp_type(func) == PROTO_TYPE) {
+                    // A let's inits are all in: fill its frame, run the body
+                    Sexp* frame = make_let_frame(func, env);
+                    for (int i = 0; i < argc; i++) {
+                        frame->data.frame.slots[i] = interp->arg_stack[base + 1 + i];
+                    }
+                    env = frame;
+                    interp->arg_top = base;
+                    sexp = func->data.proto.body;
+                    continue;
+                }
+                if (isLambda(func)) {
+                    if (jit_call(func, argc, interp->arg_stack + base + 1, &value)) {
+                        interp->arg_top = base;
+                        goto deliver;
+                    }
+                    // Tail call: run the body in this loop instead of recursing
+                    frame_stack_release(interp->cont_top > entry
+                                            ? interp->cont_stack[interp->cont_top - 1].frames
+                                            : entry_frames);
+                    env = bind_frame(func, argc, interp->arg_stack + base + 1);
+                    interp->arg_top = base;
+                    sexp = func->data.lambda.proto->data.proto.body;
+                    continue;
+                }
+                value = apply_argv(func, argc, interp->arg_stack + base + 1, env);
+                interp->arg_top = base;
+                if (interp->stack_overflowed) goto overflow;
+                goto deliver;
+            }
+        }
+    }
+
+overflow:
+    // Drop everything this call pushed and report the overflow
+    interp->cont_top = entry;
+    interp->arg_top = entry_args;
+    frame_stack_release(entry_frames);
+    value = stack_overflow_error();
+    leave_nesting();
+    return value;
+}
+
+// ============================================================================
+// BYTECODE COMPILER AND VM
+// ============================================================================
+
+// The VM runs the same closures as eval: a PROTO's resolved body is compiled
+// to bytecode the first time the VM calls it, and each call still gets a
+// FRAME, so closures made by either engine work in the other. Temporaries
+// and arguments live on a value stack instead of in cons lists, and calls
+// between lambdas push a VMFrame rather than recursing in C.
+//
+// Instructions are int words: an opcode followed by its operands.
+
+typedef enum {
+    OP_CONST,            // k       push consts[k]
+    OP_ARG,              // i       push parameter i of the current frame
+    OP_LOCAL,            // d i     push slot i of the frame d levels up
+    OP_REF,              // k       push local consts[k], or its fallback if unbound
+    OP_GLOBAL,           // k       push the value of GLOBAL_REF consts[k]
+    OP_NAME,             // k       push consts[k] looked up from env (top level)
+    OP_SET_LOCAL,        // d i     store the top into slot i, d frames up
+    OP_SET_NAME,         // k       env_set the top as consts[k]
+    OP_CLOSURE,          // k       push a closure of proto consts[k] over env
+    OP_JUMP,             // target
+    OP_JUMP_IF_FALSE,    // target  pop, and jump if it was nil
+    OP_GUARD,            // k target  jump unless FOLD_GUARD consts[k] still holds
+    OP_CALL,             // argc    call the function below argc arguments
+    OP_TAIL_CALL,        // argc    same, replacing the current call
+    OP_PRIM,             // p k     builtin vm_binary_ops[p], if GLOBAL_REF consts[k] still names it
+    OP_POP,              //         drop the top
+    OP_ENTER,            // k n     env = let frame of proto consts[k], slots from the top n
+    OP_LEAVE,            //         env = env's parent, after a let body
+    OP_RETURN
+} OpCode;
+
+static Sexp* eq_sexp(Sexp* a, Sexp* b) {
+    return eq(a, b) ? true_sexp() : nil();
+}
+
+// Two-argument primitives the VM calls directly instead of building an
+// argument list. Matched by function, so aliases such as add count too.
+static const struct {
+    PrimitiveFunc primitive;
+    Sexp* (*op)(Sexp*, Sexp*);
+} vm_binary_ops[] = {
+    { prim_add, add },
+    { prim_sub, sub },
+    { prim_mul, mul },
+    { prim_div, divide },
+    { prim_mod, mod },
+    { prim_lt, lt },
+    { prim_gt, gt },
+    { prim_lte, lte },
+    { prim_gte, gte },
+    { prim_eq, eq_sexp },
+    { prim_cons, cons },
+};
+#define VM_BINARY_OP_COUNT (int)(sizeof(vm_binary_ops) / sizeof(vm_binary_ops[0]))
+
+void set_engine(Engine engine) {
+    interp->current_engine = engine;
+}
+
+Engine get_engine(void) {
+    return interp->current_engine;
+}
+
+static void free_nodes(ProtoInfo* info);
+static void free_jit(ProtoInfo* info);
+
+static void free_proto_info(Sexp* proto) {
+    ProtoInfo* info = proto->data.proto.info;
+    free(info->code);
+    free(info->consts);
+    free_nodes(info);
+    free_jit(info);
+    free(info);
+}
+
+// Compiler state for one PROTO
+typedef struct {
+    ProtoInfo* info;
+    Sexp* env;           // Environment the code will run in
+    bool top_level;      // Unresolved form: names are looked up from env
+    int depth;           // Current stack depth
+} Compiler;
+
+static void emit(Compiler* c, int word) {
+    ProtoInfo* info = c->info;
+    if (info->code_length == info->code_capacity) {
+        int capacity = info->code_capacity ? info->code_capacity * 2 : 32;
+        int* grown = (int*)realloc(info->code, capacity * sizeof(int));
+        if (!grown) out_of_memory();
+        info->code = grown;
+        info->code_capacity = capacity;
+    }
+    info->code[info->code_length++] = word;
+}
+
+static int proto_add_const(ProtoInfo* info, Sexp* value) {
+    for (int i = 0; i < info->const_count; i++) {
+        if (info->consts[i] == value) return i;
+    }
+    if (info->const_count == info->const_capacity) {
+        int capacity = info->const_capacity ? info->const_capacity * 2 : 8;
+        Sexp** grown = (Sexp**)realloc(info->consts, capacity * sizeof(Sexp*));
+        if (!grown) out_of_memory();
+        info->consts = grown;
+        info->const_capacity = capacity;
+    }
+    info->consts[info->const_count] = value;
+    return info->const_count++;
+}
+
+static int add_const(Compiler* c, Sexp* value) {
+    return proto_add_const(c->info, value);
+}
+
+static void push_depth(Compiler* c, int n) {
+    c->depth += n;
+    if (c->depth > c->info->max_stack) {
+        c->info->max_stack = c->depth;
+    }
+}
+
+static void emit_const(Compiler* c, Sexp* value) {
+    emit(c, OP_CONST);
+    emit(c, add_const(c, value));
+    push_depth(c, 1);
+}
+
+// Emit a jump with its target left to patch_jump
+static int emit_jump(Compiler* c, OpCode op) {
+    emit(c, op);
+    emit(c, 0);
+    return c->info->code_length - 1;
+}
+
+static void patch_jump(Compiler* c, int operand) {
+    c->info->code[operand] = c->info->code_length;
+}
+
+static void compile_expr(Compiler* c, Sexp* form, bool tail);
+
+static void compile_call(Compiler* c, Sexp* form, bool tail) {
+    Sexp* head = car(form);
+    Sexp* args = cdr(form);
+    int argc = 0;
+    for (Sexp* a = args; a && sexp_type(a) == CONS_CELL; a = cdr(a)) {
+        argc++;
+    }
+
+    // (+ a b) and friends on a free name bound to a builtin: no call at all
+    if (sexp_type(head) == GLOBAL_REF && argc == 2) {
+        Sexp* func = global_ref_value(head, c->env);
+        for (int p = 0; p < VM_BINARY_OP_COUNT; p++) {
+            if (isPrimitive(func) && func->data.primitive.func == vm_binary_ops[p].primitive) {
+                compile_expr(c, car(args), false);
+                compile_expr(c, cadr(args), false);
+                emit(c, OP_PRIM);
+                emit(c, p);
+                emit(c, add_const(c, head));
+                push_depth(c, 1);  // Room to fall back to a call
+                c->depth -= 2;
+                return;
+            }
+        }
+    }
+
+    compile_expr(c, head, false);
+    for (Sexp* a = args; a && sexp_type(a) == CONS_CELL; a = cdr(a)) {
+        compile_expr(c, car(a), false);
+    }
+    emit(c, tail ? OP_TAIL_CALL : OP_CALL);
+    emit(c, argc);
+    c->depth -= argc;
+}
+
+static void compile_expr(Compiler* c, Sexp* form, bool tail) {
+    if (isNil(form) || isNumber(form) || isString(form)) {
+        emit_const(c, isNil(form) ? nil() : form);
+        return;
+    }
+
+    if (isSymbol(form)) {
+        emit(c, OP_NAME);
+        emit(c, add_const(c, form));
+        push_depth(c, 1);
+        return;
+    }
+
+    if (sexp_type(form) == GLOBAL_REF) {
+        emit(c, OP_GLOBAL);
+        emit(c, add_const(c, form));
+        push_depth(c, 1);
+        return;
+    }
+
+    if (sexp_type(form) == LOCAL_REF) {
+        if (form->data.ref.fallback) {
+            emit(c, OP_REF);
+            emit(c, add_const(c, form));
+        } else if (form->data.ref.depth == 0) {
+            emit(c, OP_ARG);
+            emit(c, form->data.ref.index);
+        } else {
+            emit(c, OP_LOCAL);
+            emit(c, form->data.ref.depth);
+            emit(c, form->data.ref.index);
+        }
+        push_depth(c, 1);
+        return;
+    }
+
+    if (sexp_type(form) == PROTO_TYPE) {
+        emit(c, OP_CLOSURE);
+        emit(c, add_const(c, form));
+        push_depth(c, 1);
+        return;
+    }
+
+    if (sexp_type(form) == FOLD_GUARD) {
+        emit(c, OP_GUARD);
+        emit(c, add_const(c, form));
+        int to_original = c->info->code_length;
+        emit(c, 0);
+        compile_expr(c, form->data.guard.folded, tail);
+        int to_end = emit_jump(c, OP_JUMP);
+        c->depth--;
+        patch_jump(c, to_original);
+        compile_expr(c, form->data.guard.original, tail);
+        patch_jump(c, to_end);
+        return;
+    }
+
+    if (sexp_type(form) != CONS_CELL) {
+        emit_const(c, form);
+        return;
+    }
+
+    Sexp* head = car(form);
+    if (!isSymbol(head) || symbol_form(head) == FORM_NONE) {
+        compile_call(c, form, tail);
+        return;
+    }
+
+    switch (symbol_form(head)) {
+        case FORM_QUOTE:
+            emit_const(c, cadr(form));
+            return;
+
+        case FORM_SET: {
+            Sexp* target = cadr(form);
+            compile_expr(c, caddr(form), false);
+            if (sexp_type(target) == LOCAL_REF) {
+                emit(c, OP_SET_LOCAL);
+                emit(c, target->data.ref.depth);
+                emit(c, target->data.ref.index);
+            } else {
+                emit(c, OP_SET_NAME);
+                emit(c, add_const(c, target));
+            }
+            return;
+        }
+
+        case FORM_DEFINE: {
+            // Only unresolved top-level code still has define and lambda;
+            // it runs once, in c->env, so the proto can be made right away
+            Sexp* proto = make_proto(caddr(form), make_body(cdddr(form)), c->env);
+            emit(c, OP_CLOSURE);
+            emit(c, add_const(c, proto));
+            push_depth(c, 1);
+            emit(c, OP_SET_NAME);
+            emit(c, add_const(c, cadr(form)));
+            return;
+        }
+
+        case FORM_LAMBDA: {
+            Sexp* proto = make_proto(cadr(form), make_body(cddr(form)), c->env);
+            emit(c, OP_CLOSURE);
+            emit(c, add_const(c, proto));
+            push_depth(c, 1);
+            return;
+        }
+
+        case FORM_IF: {
+            compile_expr(c, cadr(form), false);
+            int to_else = emit_jump(c, OP_JUMP_IF_FALSE);
+            c->depth--;
+            compile_expr(c, caddr(form), tail);
+            int to_end = emit_jump(c, OP_JUMP);
+            c->depth--;
+            patch_jump(c, to_else);
+            compile_expr(c, cadddr(form), tail);
+            patch_jump(c, to_end);
+            return;
+        }
+
+        case FORM_AND: {
+            compile_expr(c, cadr(form), false);
+            int to_nil = emit_jump(c, OP_JUMP_IF_FALSE);
+            c->depth--;
+            compile_expr(c, caddr(form), tail);
+            int to_end = emit_jump(c, OP_JUMP);
+            c->depth--;
+            patch_jump(c, to_nil);
+            emit_const(c, nil());
+            patch_jump(c, to_end);
+            return;
+        }
+
+        case FORM_OR: {
+            compile_expr(c, cadr(form), false);
+            int to_second = emit_jump(c, OP_JUMP_IF_FALSE);
+            c->depth--;
+            emit_const(c, true_sexp());
+            int to_end = emit_jump(c, OP_JUMP);
+            c->depth--;
+            patch_jump(c, to_second);
+            compile_expr(c, caddr(form), tail);
+            patch_jump(c, to_end);
+            return;
+        }
+
+        case FORM_COND: {
+            // Each matching clause jumps to the end; the ends are chained
+            // through their operands and patched once the end is known
+            int chain = -1;
+            for (Sexp* clauses = cdr(form); clauses && sexp_type(clauses) == CONS_CELL; clauses = cdr(clauses)) {
+                Sexp* clause = car(clauses);
+                compile_expr(c, car(clause), false);
+                int to_next = emit_jump(c, OP_JUMP_IF_FALSE);
+                c->depth--;
+                compile_expr(c, cadr(clause), tail);
+                int to_end = emit_jump(c, OP_JUMP);
+                c->info->code[to_end] = chain;
+                chain = to_end;
+                c->depth--;
+                patch_jump(c, to_next);
+            }
+            emit_const(c, nil());  // No clause matched
+            while (chain >= 0) {
+                int next = c->info->code[chain];
+                patch_jump(c, chain);
+                chain = next;
+            }
+            return;
+        }
+
+        case FORM_BEGIN: {
+            Sexp* forms = cdr(form);
+            if (isNil(forms)) {
+                emit_const(c, nil());
+                return;
+            }
+            for (; !isNil(cdr(forms)); forms = cdr(forms)) {
+                compile_expr(c, car(forms), false);
+                emit(c, OP_POP);
+                c->depth--;
+            }
+            compile_expr(c, car(forms), tail);
+            return;
+        }
+
+        case FORM_LET:
+        case FORM_LET_STAR:
+        case FORM_LETREC: {
+            // The body is compiled inline, running with env switched to
+            // the let frame; a tail position returns from inside it
+            if (sexp_type(cadr(form)) != PROTO_TYPE) {
+                form = resolve_let_in_env(form, c->env);
+            }
+            int proto = add_const(c, cadr(form));
+            if (symbol_form(head) == FORM_LET) {
+                int n = 0;
+                for (Sexp* i = cddr(form); !isNil(i); i = cdr(i), n++) {
+                    compile_expr(c, car(i), false);
+                }
+                emit(c, OP_ENTER);
+                emit(c, proto);
+                emit(c, n);
+                c->depth -= n;
+            } else {
+                emit(c, OP_ENTER);
+                emit(c, proto);
+                emit(c, 0);
+                int slot = 0;
+                for (Sexp* i = cddr(form); !isNil(i); i = cdr(i), slot++) {
+                    compile_expr(c, car(i), false);
+                    emit(c, OP_SET_LOCAL);
+                    emit(c, 0);
+                    emit(c, slot);
+                    emit(c, OP_POP);
+                    c->depth--;
+                }
+            }
+            compile_expr(c, cadr(form)->data.proto.body, tail);
+            if (!tail) emit(c, OP_LEAVE);
+            return;
+        }
+
+        case FORM_WHILE: {
+            int top = c->info->code_length;
+            compile_expr(c, cadr(form), false);
+            int to_end = emit_jump(c, OP_JUMP_IF_FALSE);
+            c->depth--;
+            for (Sexp* body = cddr(form); !isNil(body); body = cdr(body)) {
+                compile_expr(c, car(body), false);
+                emit(c, OP_POP);
+                c->depth--;
+            }
+            emit(c, OP_JUMP);
+            emit(c, top);
+            patch_jump(c, to_end);
+            emit_const(c, nil());
+            return;
+        }
+
+        case FORM_DO:
+            compile_expr(c, expand_do(form), tail);
+            return;
+
+        case FORM_FUTURE:
+            compile_expr(c, expand_future(form), tail);
+            return;
+
+        default:
+            compile_call(c, form, tail);
+            return;
+    }
+}
+
+static void compile_proto(Sexp* proto, Sexp* env, bool top_level) {
+    Compiler c = { proto->data.proto.info, env, top_level, 0 };
+    compile_expr(&c, proto->data.proto.body, true);
+    emit(&c, OP_RETURN);
+}
+
+// VM state. Temporaries live on the argument stack and call records in a
+// growable array; the collector marks both, so arg_top must be current
+// before anything that can allocate.
+typedef struct VMFrame {
+    Sexp* proto;
+    const int* pc;
+    Sexp* env;
+    size_t base;         // Stack index of this call's first temporary
+    FrameMark frames;    // Frame stack top before this call's frame
+} VMFrame;
+
+static void gc_mark_vm(void) {
+    for (size_t i = 0; i < interp->vm_frame_count; i++) {
+        gc_mark(interp->vm_frames[i].proto);
+        gc_mark(interp->vm_frames[i].env);
+    }
+}
+
+// Returns NULL at the depth limit, like cont_push()
+static VMFrame* vm_push_frame(void) {
+    if (!depth_available(interp->vm_frame_count)) return NULL;
+    if (interp->vm_frame_count == interp->vm_frame_capacity) {
+        size_t capacity = interp->vm_frame_capacity ? interp->vm_frame_capacity * 2 : 64;
+        VMFrame* grown = (VMFrame*)realloc(interp->vm_frames, capacity * sizeof(VMFrame));
+        if (!grown) return NULL;
+        interp->vm_frames = grown;
+        interp->vm_frame_capacity = capacity;
+    }
+    return &interp->vm_frames[interp->vm_frame_count++];
+}
+
+// A local that set/define may not have assigned yet: follow its fallbacks
+// the way eval does
+static Sexp* vm_load_ref(Sexp* ref, Sexp* env) {
+    while (sexp_type(ref) == LOCAL_REF) {
+        Sexp* value = *local_slot(ref, env);
+        if (value != UNBOUND) return value;
+        ref = ref->data.ref.fallback;
+    }
+    return global_ref_value(ref, env);
+}
+
+// Run proto's code in env until its outermost call returns
+static Sexp* vm_run(Sexp* proto, Sexp* env) {
+    LOCAL_INTERP;
+    size_t entry = interp->vm_frame_count;
+    size_t entry_args = interp->arg_top;
+    FrameMark entry_frames = frame_stack_mark();
+    ProtoInfo* info = proto->data.proto.info;
+
+    if (interp->eval_nesting >= EVAL_MAX_NESTING) {
+        return stack_overflow_error();
+    }
+    interp->eval_nesting++;
+    VMFrame* frame = vm_push_frame();
+    if (!frame) goto overflow;
+
+    arg_reserve(interp->arg_top + info->max_stack);
+    frame->proto = proto;
+    frame->env = env;
+    frame->base = interp->arg_top;
+    frame->frames = entry_frames;
+
+    const int* code = info->code;
+    const int* pc = code;
+    Sexp** consts = info->consts;
+    Sexp** sp = interp->arg_stack + interp->arg_top;
+    int argc;
+    bool tail;
+
+// Publish sp before anything that may allocate and so collect
+#define SYNC() (interp->arg_top = (size_t)(sp - interp->arg_stack))
+
+    while (1) {
+        switch ((OpCode)*pc++) {
+            case OP_CONST:
+                *sp++ = consts[*pc++];
+                break;
+
+            case OP_ARG:
+                *sp++ = env->data.frame.slots[*pc++];
+                break;
+
+            case OP_LOCAL: {
+                Sexp* e = env;
+                for (int depth = *pc++; depth > 0; depth--) {
+                    e = e->data.frame.parent;
+                }
+                *sp++ = e->data.frame.slots[*pc++];
+                break;
+            }
+
+            case OP_REF: {
+                SYNC();
+                Sexp* value = vm_load_ref(consts[*pc++], env);
+                *sp++ = value;
+                break;
+            }
+
+            case OP_GLOBAL: {
+                SYNC();
+                Sexp* value = global_ref_value(consts[*pc++], env);
+                *sp++ = value;
+                break;
+            }
+
+            case OP_NAME: {
+                SYNC();
+                Sexp* value = env_lookup(env, consts[*pc++]);
+                *sp++ = value;
+                break;
+            }
+
+            case OP_SET_LOCAL: {
+                Sexp* e = env;
+                for (int depth = *pc++; depth > 0; depth--) {
+                    e = e->data.frame.parent;
+                }
+                e->data.frame.slots[*pc++] = sp[-1];
+                break;
+            }
+
+            case OP_SET_NAME:
+                SYNC();
+                sp[-1] = env_set(env, consts[*pc++], sp[-1]);
+                break;
+
+            case OP_CLOSURE: {
+                SYNC();
+                Sexp* closure = make_closure(consts[*pc++], env);
+                *sp++ = closure;
+                break;
+            }
+
+            case OP_POP:
+                sp--;
+                break;
+
+            case OP_ENTER: {
+                SYNC();
+                Sexp* let_env = make_let_frame(consts[*pc++], env);
+                int n = *pc++;
+                for (int i = 0; i < n; i++) {
+                    let_env->data.frame.slots[i] = sp[i - n];
+                }
+                sp -= n;
+                // The call record holds the env to come back to after calls
+                env = let_env;
+                interp->vm_frames[interp->vm_frame_count - 1].env = env;
+                break;
+            }
+
+            case OP_LEAVE: {
+                Sexp* let_env = env;
+                env = env->data.frame.parent;
+                interp->vm_frames[interp->vm_frame_count - 1].env = env;
+                if (let_env->data.frame.proto->data.proto.info->stack_frames) {
+                    frame_stack_pop(let_env);
+                }
+                break;
+            }
+
+            case OP_JUMP:
+                pc = code + *pc;
+                break;
+
+            case OP_JUMP_IF_FALSE:
+                if (isNil(*--sp)) {
+                    pc = code + *pc;
+                } else {
+                    pc++;
+                }
+                break;
+
+            case OP_GUARD:
+                SYNC();
+                if (guard_holds(consts[pc[0]], env)) {
+                    pc += 2;
+                } else {
+                    pc = code + pc[1];
+                }
+                break;
+
+            case OP_PRIM: {
+                int p = *pc++;
+                Sexp* name = consts[*pc++];
+                SYNC();
+                Sexp* func = global_ref_value(name, env);
+                if (isPrimitive(func) && func->data.primitive.func == vm_binary_ops[p].primitive) {
+                    Sexp* result = vm_binary_ops[p].op(sp[-2], sp[-1]);
+                    sp[-2] = result;
+                    sp--;
+                    break;
+                }
+                // The name has been rebound since compiling: call it normally
+                sp[0] = sp[-1];
+                sp[-1] = sp[-2];
+                sp[-2] = func;
+                sp++;
+                argc = 2;
+                tail = false;
+                goto call;
+            }
+
+            case OP_CALL:
+            case OP_TAIL_CALL:
+                tail = pc[-1] == OP_TAIL_CALL;
+                argc = *pc++;
+            call: {
+                Sexp* func = sp[-argc - 1];
+                Sexp* result;
+
+                // OP_PRIM's cons may have run out of heap in the arguments
+                if (interp->stack_overflowed) goto overflow;
+                if (isLambda(func)) {
+                    if (jit_call(func, argc, sp - argc, &result)) goto called;
+                    Sexp* callee = func->data.lambda.proto;
+                    ProtoInfo* callee_info = callee->data.proto.info;
+                    SYNC();
+                    if (!callee_info->code) {
+                        compile_proto(callee, func->data.lambda.env, false);
+                    }
+                    // A tail call's frames are done with; pop them first
+                    if (tail) {
+                        frame_stack_release(interp->vm_frames[interp->vm_frame_count - 1].frames);
+                    }
+                    FrameMark frames = frame_stack_mark();
+                    Sexp* new_env = make_frame(callee, func->data.lambda.env);
+                    Sexp** args = sp - argc;
+                    for (int i = 0; i < callee_info->arity; i++) {
+                        new_env->data.frame.slots[i] = i < argc ? args[i] : nil();
+                    }
+                    sp -= argc + 1;
+
+                    if (tail) {
+                        // Reuse the current call's record and stack space
+                        frame = &interp->vm_frames[interp->vm_frame_count - 1];
+                    } else {
+                        interp->vm_frames[interp->vm_frame_count - 1].pc = pc;
+                        SYNC();
+                        frame = vm_push_frame();
+                        if (!frame) goto overflow;
+                        frame->base = interp->arg_top;
+                        frame->frames = frames;
+                    }
+                    frame->proto = callee;
+                    frame->env = new_env;
+
+                    interp->arg_top = frame->base;
+                    arg_reserve(frame->base + callee_info->max_stack);
+                    sp = interp->arg_stack + interp->arg_top;
+                    env = new_env;
+                    code = callee_info->code;
+                    pc = code;
+                    consts = callee_info->consts;
+                    break;
+                }
+
+                if (isPrimitive(func)) {
+                    SYNC();
+                    result = call_primitive(func, argc, sp - argc, env);
+                    // A primitive that calls back into Lisp may have grown
+                    // (and so moved) the argument stack
+                    sp = interp->arg_stack + interp->arg_top;
+                    if (interp->stack_overflowed) goto overflow;
+                } else {
+                    result = make_symbol("ERROR:NOT_A_FUNCTION");
+                }
+            called:
+                sp -= argc;
+                sp[-1] = result;
+                if (!tail) break;
+            }
+            // A tail call to a primitive returns its result straight away
+            // fallthrough
+
+            case OP_RETURN: {
+                Sexp* result = sp[-1];
+                interp->vm_frame_count--;
+                sp = interp->arg_stack + interp->vm_frames[interp->vm_frame_count].base;
+                frame_stack_release(interp->vm_frames[interp->vm_frame_count].frames);
+                if (interp->vm_frame_count == entry) {
+                    interp->arg_top = (size_t)(sp - interp->arg_stack);
+                    leave_nesting();
+                    return result;
+                }
+                frame = &interp->vm_frames[interp->vm_frame_count - 1];
+                env = frame->env;
+                info = frame->proto->data.proto.info;
+                code = info->code;
+                pc = frame->pc;
+                consts = info->consts;
+                *sp++ = result;
+                break;
+            }
+        }
+    }
+#undef SYNC
+
+overflow:
+    // Drop this run's call records and temporaries, as eval does
+    interp->vm_frame_count = entry;
+    interp->arg_top = entry_args;
+    frame_stack_release(entry_frames);
+    Sexp* error = stack_overflow_error();
+    leave_nesting();
+    return error;
+}
+
+// Top-level forms run once, so they're compiled as they are, unresolved,
+// into a parameterless proto of their own
+Sexp* vm_eval(Sexp* sexp, Sexp* env) {
+    Sexp* proto = make_proto_cell(nil(), sexp, 0, 0);
+    compile_proto(proto, env, true);
+    return vm_run(proto, env);
+}
+
+// Call a closure on the VM from C, for native code calling back into Lisp
+static Sexp* vm_apply(Sexp* func, int argc, Sexp** argv) {
+    Sexp* proto = func->data.lambda.proto;
+    if (!proto->data.proto.info->code) {
+        compile_proto(proto, func->data.lambda.env, false);
+    }
+    FrameMark mark = frame_stack_mark();
+    Sexp* result = vm_run(proto, bind_frame(func, argc, argv));
+    frame_stack_release(mark);
+    return result;
+}
+
+Sexp* evaluate(Sexp* sexp, Sexp* env) {
+    if (interp->current_engine == ENGINE_VM) {
+        return vm_eval(sexp, env);
+    }
+    if (interp->current_engine == ENGINE_NODES) {
+        return node_eval(sexp, env);
+    }
+    return eval(sexp, env);
+}
+
+// ============================================================================
+// CLOSURE COMPILER
+// ============================================================================
+
+// The third engine. The first time a lambda runs, its resolved body is
+// analyzed into a tree of Nodes, each holding the C function that runs it
+// and what that function needs already decoded: a constant, a slot
+// position, a cached global, its operands. Running the body is then a
+// chain of indirect calls, with no type tests on forms, no special-form
+// dispatch and no cadr walks. The tree is kept with the lambda's template,
+// next to its bytecode.
+//
+// Nodes run on the C stack. A call in tail position leaves its arguments
+// on the argument stack and returns TAIL_CALL to the loop that called the
+// current lambda, which binds the new frame in place. Nested calls count
+// against the same depth limit as eval's stack. Once they have used
+// NODE_STACK_BUDGET of C stack, further calls run on eval, which keeps its
+// stack on the heap, so deep recursion still works.
+
+typedef struct Node Node;
+typedef Sexp* (*NodeFunc)(Node* node, Sexp* env);
+
+struct Node {
+    NodeFunc run;
+    Sexp* value;         // Constant, name, reference or PROTO; kept alive
+                         // by the form it came from, or by consts
+    int depth;           // Local slots: frames up and index; for
+    int index;           // node_prim2, the vm_binary_ops entry
+    int count;           // Entries in kids
+    Node** kids;         // Operands, callee first for calls
+    Node* body;          // let: the body, run in the new frame
+    Node* next;          // Every node of a tree, for freeing
+};
+
+typedef struct {
+    ProtoInfo* info;     // Owns the nodes; consts keep top-level protos alive
+    Sexp* env;           // Environment the tree will run in
+    int nesting;         // How deep the form being analyzed is
+} Analyzer;
+
+#define NODE_STACK_BUDGET ((uintptr_t)2 << 20)
+
+// Forms nested deeper than this inside one body are left to eval
+#define NODE_MAX_NESTING 500
+
+// Calls below node_stack_floor go to eval; node_runs counts the
+// node_eval/node_apply calls active, and node_depth the lambda calls.
+
+// Returned by a call in tail position; the callee and its arguments are
+// on the argument stack from tail_base up
+static Sexp tail_call_marker = { ATOM_SYMBOL, true, FORM_NONE, { .symbol = (char*)"TAIL_CALL" } };
+#define TAIL_CALL (&tail_call_marker)
+
+static void free_nodes(ProtoInfo* info) {
+    Node* node = info->nodes;
+    while (node) {
+        Node* next = node->next;
+        free(node->kids);
+        free(node);
+        node = next;
+    }
+}
+
+static Node* new_node(Analyzer* a, NodeFunc run, Sexp* value, int count) {
+    Node* node = (Node*)calloc(1, sizeof(Node));
+    if (!node) out_of_memory();
+    if (count > 0) {
+        node->kids = (Node**)calloc(count, sizeof(Node*));
+        if (!node->kids) out_of_memory();
+    }
+    node->run = run;
+    node->value = value;
+    node->count = count;
+    node->next = a->info->nodes;
+    a->info->nodes = node;
+    return node;
+}
+
+static Node* analyze(Analyzer* a, Sexp* form, bool tail);
+
+static Node* lambda_tree(Sexp* func) {
+    Sexp* proto = func->data.lambda.proto;
+    ProtoInfo* info = proto->data.proto.info;
+    if (!info->tree) {
+        Analyzer a = { info, func->data.lambda.env, 0 };
+        info->tree = analyze(&a, proto->data.proto.body, true);
+    }
+    return info->tree;
+}
+
+// Finish the calls a body returned TAIL_CALL for, each in place of the
+// last; mark is the frame stack top before the first frame
+static Sexp* run_tail_calls(Sexp* result, FrameMark mark) {
+    while (result == TAIL_CALL) {
+        Sexp* func = interp->arg_stack[interp->tail_base];
+        int argc = (int)(interp->arg_top - interp->tail_base - 1);
+        if (jit_call(func, argc, interp->arg_stack + interp->tail_base + 1, &result)) {
+            interp->arg_top = interp->tail_base;
+            break;
+        }
+        frame_stack_release(mark);
+        Sexp* frame = bind_frame(func, argc, interp->arg_stack + interp->tail_base + 1);
+        interp->arg_top = interp->tail_base;
+        Node* tree = lambda_tree(func);
+        result = tree->run(tree, frame);
+    }
+    return result;
+}
+
+static Sexp* call_lambda(Sexp* func, int argc, Sexp** argv) {
+    if (!depth_available(interp->node_depth)) return stack_overflow_error();
+    if ((uintptr_t)__builtin_frame_address(0) < interp->node_stack_floor) {
+        return apply_argv(func, argc, argv, nil());
+    }
+    Sexp* result;
+    if (jit_call(func, argc, argv, &result)) return result;
+    interp->node_depth++;
+    FrameMark mark = frame_stack_mark();
+    Node* tree = lambda_tree(func);
+    result = tree->run(tree, bind_frame(func, argc, argv));
+    result = run_tail_calls(result, mark);
+    frame_stack_release(mark);
+    interp->node_depth--;
+    return result;
+}
+
+// Call the function at arg_stack[base] on the argc values above it
+static Sexp* invoke(size_t base, int argc, Sexp* env) {
+    Sexp* func = interp->arg_stack[base];
+    Sexp* result;
+    if (isLambda(func)) {
+        result = call_lambda(func, argc, interp->arg_stack + base + 1);
+    } else if (isPrimitive(func)) {
+        result = call_primitive(func, argc, interp->arg_stack + base + 1, env);
+    } else {
+        result = make_symbol("ERROR:NOT_A_FUNCTION");
+    }
+    interp->arg_top = base;
+    return result;
+}
+
+static Sexp* node_const(Node* n, Sexp* env) {
+    (void)env;
+    return n->value;
+}
+
+static Sexp* node_arg(Node* n, Sexp* env) {
+    return env->data.frame.slots[n->index];
+}
+
+static Sexp* node_local(Node* n, Sexp* env) {
+    for (int d = n->depth; d > 0; d--) {
+        env = env->data.frame.parent;
+    }
+    return env->data.frame.slots[n->index];
+}
+
+static Sexp* node_ref(Node* n, Sexp* env) {
+    return vm_load_ref(n->value, env);
+}
+
+static Sexp* node_global(Node* n, Sexp* env) {
+    return global_ref_value(n->value, env);
+}
+
+static Sexp* node_name(Node* n, Sexp* env) {
+    return env_lookup(env, n->value);
+}
+
+static Sexp* node_closure(Node* n, Sexp* env) {
+    return make_closure(n->value, env);
+}
+
+static Sexp* node_set_local(Node* n, Sexp* env) {
+    Sexp* value = n->kids[0]->run(n->kids[0], env);
+    Sexp* frame = env;
+    for (int d = n->depth; d > 0; d--) {
+        frame = frame->data.frame.parent;
+    }
+    frame->data.frame.slots[n->index] = value;
+    return value;
+}
+
+static Sexp* node_set_name(Node* n, Sexp* env) {
+    Sexp* value = n->kids[0]->run(n->kids[0], env);
+    return env_set(env, n->value, value);
+}
+
+static Sexp* node_if(Node* n, Sexp* env) {
+    Sexp* test = n->kids[0]->run(n->kids[0], env);
+    Node* branch = isTrueSexp(test) ? n->kids[1] : n->kids[2];
+    return branch->run(branch, env);
+}
+
+static Sexp* node_and(Node* n, Sexp* env) {
+    if (isNil(n->kids[0]->run(n->kids[0], env))) return nil();
+    return n->kids[1]->run(n->kids[1], env);
+}
+
+static Sexp* node_or(Node* n, Sexp* env) {
+    if (!isNil(n->kids[0]->run(n->kids[0], env))) return true_sexp();
+    return n->kids[1]->run(n->kids[1], env);
+}
+
+// kids hold (test, value) pairs
+static Sexp* node_cond(Node* n, Sexp* env) {
+    for (int i = 0; i < n->count; i += 2) {
+        if (isTrueSexp(n->kids[i]->run(n->kids[i], env))) {
+            return n->kids[i + 1]->run(n->kids[i + 1], env);
+        }
+    }
+    return nil();
+}
+
+static Sexp* node_begin(Node* n, Sexp* env) {
+    for (int i = 0; i < n->count - 1; i++) {
+        n->kids[i]->run(n->kids[i], env);
+    }
+    return n->kids[n->count - 1]->run(n->kids[n->count - 1], env);
+}
+
+// let: every init runs in env, then the body in the new frame
+static Sexp* node_let(Node* n, Sexp* env) {
+    size_t base = interp->arg_top;
+    for (int i = 0; i < n->count; i++) {
+        arg_push(n->kids[i]->run(n->kids[i], env));
+    }
+    FrameMark mark = frame_stack_mark();
+    Sexp* frame = make_let_frame(n->value, env);
+    for (int i = 0; i < n->count; i++) {
+        frame->data.frame.slots[i] = interp->arg_stack[base + i];
+    }
+    interp->arg_top = base;
+    Sexp* result = n->body->run(n->body, frame);
+    frame_stack_release(mark);  // A pending tail call has its arguments
+    return result;
+}
+
+// let* and letrec: the inits run in the new frame, filling it in order
+static Sexp* node_let_seq(Node* n, Sexp* env) {
+    FrameMark mark = frame_stack_mark();
+    Sexp* frame = make_let_frame(n->value, env);
+    for (int i = 0; i < n->count; i++) {
+        frame->data.frame.slots[i] = n->kids[i]->run(n->kids[i], frame);
+    }
+    Sexp* result = n->body->run(n->body, frame);
+    frame_stack_release(mark);
+    return result;
+}
+
+// kids[0] is the test, the rest the body
+static Sexp* node_while(Node* n, Sexp* env) {
+    while (!interp->stack_overflowed && isTrueSexp(n->kids[0]->run(n->kids[0], env))) {
+        for (int i = 1; i < n->count; i++) {
+            n->kids[i]->run(n->kids[i], env);
+        }
+    }
+    return interp->stack_overflowed ? overflow_value() : nil();
+}
+
+static Sexp* node_call(Node* n, Sexp* env) {
+    if (interp->stack_overflowed) return overflow_value();
+    size_t base = interp->arg_top;
+    for (int i = 0; i < n->count; i++) {
+        arg_push(n->kids[i]->run(n->kids[i], env));
+    }
+    return invoke(base, n->count - 1, env);
+}
+
+static Sexp* node_tail_call(Node* n, Sexp* env) {
+    if (interp->stack_overflowed) return overflow_value();
+    size_t base = interp->arg_top;
+    for (int i = 0; i < n->count; i++) {
+        arg_push(n->kids[i]->run(n->kids[i], env));
+    }
+    if (isLambda(interp->arg_stack[base])) {
+        interp->tail_base = base;
+        return TAIL_CALL;
+    }
+    return invoke(base, n->count - 1, env);
+}
+
+// (+ a b) and friends on a free name bound to a builtin, as OP_PRIM
+static Sexp* node_prim2(Node* n, Sexp* env) {
+    Sexp* x = n->kids[0]->run(n->kids[0], env);
+    Sexp* y = n->kids[1]->run(n->kids[1], env);
+    Sexp* func = global_ref_value(n->value, env);
+    if (isPrimitive(func) && func->data.primitive.func == vm_binary_ops[n->index].primitive) {
+        return vm_binary_ops[n->index].op(x, y);
+    }
+    // The name has been rebound since analysis: call it normally
+    if (interp->stack_overflowed) return overflow_value();
+    size_t base = interp->arg_top;
+    arg_push(func);
+    arg_push(x);
+    arg_push(y);
+    return invoke(base, 2, env);
+}
+
+// A folded form: value is the FOLD_GUARD, kids the folded form and the
+// original
+static Sexp* node_guard(Node* n, Sexp* env) {
+    Node* branch = guard_holds(n->value, env) ? n->kids[0] : n->kids[1];
+    return branch->run(branch, env);
+}
+
+static Sexp* node_eval_form(Node* n, Sexp* env) {
+    return eval(n->value, env);
+}
+
+static Node* analyze_call(Analyzer* a, Sexp* form, bool tail) {
+    Sexp* head = car(form);
+    int argc = 0;
+    for (Sexp* arg = cdr(form); sexp_is_cons(arg); arg = cdr(arg)) {
+        argc++;
+    }
+
+    if (sexp_type(head) == GLOBAL_REF && argc == 2) {
+        Sexp* func = global_ref_value(head, a->env);
+        for (int p = 0; p < VM_BINARY_OP_COUNT; p++) {
+            if (isPrimitive(func) && func->data.primitive.func == vm_binary_ops[p].primitive) {
+                Node* node = new_node(a, node_prim2, head, 2);
+                node->index = p;
+                node->kids[0] = analyze(a, cadr(form), false);
+                node->kids[1] = analyze(a, caddr(form), false);
+                return node;
+            }
+        }
+    }
+
+    Node* node = new_node(a, tail ? node_tail_call : node_call, NULL, argc + 1);
+    int i = 0;
+    for (Sexp* f = form; sexp_is_cons(f); f = cdr(f)) {
+        node->kids[i++] = analyze(a, car(f), false);
+    }
+    return node;
+}
+
+static Node* analyze_form(Analyzer* a, Sexp* form, bool tail) {
+    if (isNil(form) || isNumber(form) || isString(form)) {
+        return new_node(a, node_const, isNil(form) ? nil() : form, 0);
+    }
+
+    if (isSymbol(form)) {
+        return new_node(a, node_name, form, 0);
+    }
+
+    if (sexp_type(form) == GLOBAL_REF) {
+        return new_node(a, node_global, form, 0);
+    }
+
+    if (sexp_type(form) == LOCAL_REF) {
+        if (form->data.ref.fallback) {
+            return new_node(a, node_ref, form, 0);
+        }
+        Node* node = new_node(a, form->data.ref.depth == 0 ? node_arg : node_local, form, 0);
+        node->depth = form->data.ref.depth;
+        node->index = form->data.ref.index;
+        return node;
+    }
+
+    if (sexp_type(form) == PROTO_TYPE) {
+        return new_node(a, node_closure, form, 0);
+    }
+
+    if (sexp_type(form) == FOLD_GUARD) {
+        Node* node = new_node(a, node_guard, form, 2);
+        node->kids[0] = analyze(a, form->data.guard.folded, tail);
+        node->kids[1] = analyze(a, form->data.guard.original, tail);
+        return node;
+    }
+
+    if (sexp_type(form) != CONS_CELL) {
+        return new_node(a, node_const, form, 0);
+    }
+
+    Sexp* head = car(form);
+    if (!isSymbol(head) || symbol_form(head) == FORM_NONE) {
+        return analyze_call(a, form, tail);
+    }
+
+    switch (symbol_form(head)) {
+        case FORM_QUOTE:
+            return new_node(a, node_const, cadr(form), 0);
+
+        case FORM_SET: {
+            Sexp* target = cadr(form);
+            Node* node;
+            if (sexp_type(target) == LOCAL_REF) {
+                node = new_node(a, node_set_local, target, 1);
+                node->depth = target->data.ref.depth;
+                node->index = target->data.ref.index;
+            } else {
+                node = new_node(a, node_set_name, target, 1);
+            }
+            node->kids[0] = analyze(a, caddr(form), false);
+            return node;
+        }
+
+        case FORM_DEFINE: {
+            // Only unresolved top-level code still has define and lambda;
+            // it runs once, in a->env, so the proto can be made right away
+            Sexp* proto = make_proto(caddr(form), make_body(cdddr(form)), a->env);
+            proto_add_const(a->info, proto);
+            Node* node = new_node(a, node_set_name, cadr(form), 1);
+            node->kids[0] = new_node(a, node_closure, proto, 0);
+            return node;
+        }
+
+        case FORM_LAMBDA: {
+            Sexp* proto = make_proto(cadr(form), make_body(cddr(form)), a->env);
+            proto_add_const(a->info, proto);
+            return new_node(a, node_closure, proto, 0);
+        }
+
+        case FORM_IF: {
+            Node* node = new_node(a, node_if, NULL, 3);
+            node->kids[0] = analyze(a, cadr(form), false);
+            node->kids[1] = analyze(a, caddr(form), tail);
+            node->kids[2] = analyze(a, cadddr(form), tail);
+            return node;
+        }
+
+        case FORM_AND:
+        case FORM_OR: {
+            Node* node = new_node(a, symbol_form(head) == FORM_AND ? node_and : node_or, NULL, 2);
+            node->kids[0] = analyze(a, cadr(form), false);
+            node->kids[1] = analyze(a, caddr(form), tail);
+            return node;
+        }
+
+        case FORM_COND: {
+            int clauses = 0;
+            for (Sexp* c = cdr(form); sexp_is_cons(c); c = cdr(c)) {
+                clauses++;
+            }
+            Node* node = new_node(a, node_cond, NULL, clauses * 2);
+            int i = 0;
+            for (Sexp* c = cdr(form); sexp_is_cons(c); c = cdr(c)) {
+                node->kids[i++] = analyze(a, car(car(c)), false);
+                node->kids[i++] = analyze(a, cadr(car(c)), tail);
+            }
+            return node;
+        }
+
+        case FORM_BEGIN: {
+            int count = 0;
+            for (Sexp* f = cdr(form); sexp_is_cons(f); f = cdr(f)) {
+                count++;
+            }
+            if (count == 0) return new_node(a, node_const, nil(), 0);
+            Node* node = new_node(a, node_begin, NULL, count);
+            int i = 0;
+            for (Sexp* f = cdr(form); sexp_is_cons(f); f = cdr(f), i++) {
+                node->kids[i] = analyze(a, car(f), tail && i == count - 1);
+            }
+            return node;
+        }
+
+        case FORM_LET:
+        case FORM_LET_STAR:
+        case FORM_LETREC: {
+            if (sexp_type(cadr(form)) != PROTO_TYPE) {
+                form = resolve_let_in_env(form, a->env);
+                proto_add_const(a->info, form);
+            }
+            Sexp* proto = cadr(form);
+            int count = 0;
+            for (Sexp* i = cddr(form); sexp_is_cons(i); i = cdr(i)) {
+                count++;
+            }
+            Node* node = new_node(a, symbol_form(head) == FORM_LET ? node_let : node_let_seq, proto, count);
+            int i = 0;
+            for (Sexp* init = cddr(form); sexp_is_cons(init); init = cdr(init)) {
+                node->kids[i++] = analyze(a, car(init), false);
+            }
+            node->body = analyze(a, proto->data.proto.body, tail);
+            return node;
+        }
+
+        case FORM_WHILE: {
+            int count = 1;
+            for (Sexp* f = cddr(form); sexp_is_cons(f); f = cdr(f)) {
+                count++;
+            }
+            Node* node = new_node(a, node_while, NULL, count);
+            node->kids[0] = analyze(a, cadr(form), false);
+            int i = 1;
+            for (Sexp* f = cddr(form); sexp_is_cons(f); f = cdr(f)) {
+                node->kids[i++] = analyze(a, car(f), false);
+            }
+            return node;
+        }
+
+        case FORM_DO: {
+            Sexp* expanded = expand_do(form);
+            proto_add_const(a->info, expanded);
+            return analyze(a, expanded, tail);
+        }
+
+        case FORM_FUTURE: {
+            Sexp* expanded = expand_future(form);
+            proto_add_const(a->info, expanded);
+            return analyze(a, expanded, tail);
+        }
+
+        default:
+            return analyze_call(a, form, tail);
+    }
+}
+
+static Node* analyze(Analyzer* a, Sexp* form, bool tail) {
+    if (a->nesting >= NODE_MAX_NESTING) {
+        return new_node(a, node_eval_form, form, 0);
+    }
+    a->nesting++;
+    Node* node = analyze_form(a, form, tail);
+    a->nesting--;
+    return node;
+}
+
+static bool node_enter(void) {
+    if (interp->eval_nesting >= EVAL_MAX_NESTING) return false;
+    interp->eval_nesting++;
+    if (interp->node_runs++ == 0) {
+        interp->node_stack_floor = (uintptr_t)__builtin_frame_address(0) - NODE_STACK_BUDGET;
+    }
+    return true;
+}
+
+static Sexp* node_leave(Sexp* result) {
+    if (interp->stack_overflowed) result = overflow_value();
+    interp->node_runs--;
+    leave_nesting();
+    return result;
+}
+
+// Top-level forms are analyzed as they are, unresolved, into a
+// parameterless proto of their own
+Sexp* node_eval(Sexp* sexp, Sexp* env) {
+    if (!node_enter()) return stack_overflow_error();
+    size_t entry_args = interp->arg_top;
+    FrameMark mark = frame_stack_mark();
+    Sexp* proto = make_proto_cell(nil(), sexp, 0, 0);
+    arg_push(proto);  // Keeps it, and the protos its consts hold, alive
+
+    Analyzer a = { proto->data.proto.info, env, 0 };
+    Node* tree = analyze(&a, sexp, true);
+    Sexp* result = run_tail_calls(tree->run(tree, env), mark);
+
+    frame_stack_release(mark);
+    interp->arg_top = entry_args;
+    return node_leave(result);
+}
+
+// Call a closure on the closure compiler from C, for native code calling
+// back into Lisp
+static Sexp* node_apply(Sexp* func, int argc, Sexp** argv) {
+    if (!node_enter()) return stack_overflow_error();
+    return node_leave(call_lambda(func, argc, argv));
+}
+
+// ============================================================================
+// JIT
+// ============================================================================
+
+// A lambda called more than jit_threshold times gets native code if its
+// body only does arithmetic on its parameters and number constants: + - *
+// / %, the comparisons, not, and, or, if with an else branch, cond, and
+// calls to itself by its global name. Code is made per argument type: one
+// version for calls with all integer arguments, one for all doubles. Values
+// are unboxed int64s or doubles in rax; temporaries go on the machine stack.
+//
+// Every name the body uses is checked on entry to still be bound to what it
+// was at compile time. The body can't rebind anything, so that holds for
+// the whole run. Anything the code can't do exactly as the interpreter
+// would - an integer overflowing to a double, an inexact or zero division,
+// a NaN comparison, a cond with no clause taken, running out of stack or
+// nesting calls deeper than the engines' depth limit - abandons the run,
+// and the call is made again by the engine. Bodies have no side effects,
+// so nothing is done twice. A lambda whose code gives up too often goes
+// back to the engine for good.
+
+#ifdef LISP_JIT
+
+typedef enum {
+    JIT_INT,
+    JIT_DOUBLE,
+    JIT_FAIL             // The form can't be compiled
+} JitType;
+
+// Native code: args holds the parameters, unboxed; returns 1 with the
+// result in *result, or 0 if the run was abandoned. Recursion stops at
+// stack address floor, or past depth nested calls.
+typedef int (*JitEntry)(const int64_t* args, int64_t* result, uintptr_t floor,
+                        uint64_t depth);
+
+typedef struct {
+    Sexp* ref;           // A GLOBAL_REF of the body
+    Sexp* value;         // What it must be bound to; NULL for this lambda
+} JitGuard;
+
+typedef struct JitCode {
+    JitEntry entry;      // NULL if the body can't be compiled for these
+                         // arguments, or gave up too often
+    void* memory;        // Executable mapping holding the code
+    size_t size;
+    JitType result;
+    JitGuard* guards;
+    int guard_count;
+    int bailouts;        // Runs abandoned so far
+} JitCode;
+
+#define JIT_MAX_ARGS 8
+#define JIT_MAX_BAILOUTS 8
+#define JIT_STACK_BUDGET ((uintptr_t)512 << 10)
+
+// Code buffer and state for compiling one body
+typedef struct {
+    unsigned char* code;
+    int length;
+    int capacity;
+    Sexp* proto;
+    Sexp* env;           // Closure environment names are looked up in
+    int arity;
+    JitType args;        // Type of every parameter
+    JitType result;      // Type calls to itself are assumed to return
+    int bail;            // Offset of the code that abandons the run
+    int body;            // Offset of the body's entry, for calls
+    int loop;            // Offset past its prologue, for tail calls
+    JitGuard* guards;
+    int guard_count;
+    int guard_capacity;
+} Jit;
+
+// Condition codes, as the low nibble of jcc; flipping bit 0 negates one
+#define CC_OVERFLOW   0x0
+#define CC_BELOW      0x2
+#define CC_ABOVE_EQ   0x3
+#define CC_EQUAL      0x4
+#define CC_NOT_EQUAL  0x5
+#define CC_BELOW_EQ   0x6
+#define CC_ABOVE      0x7
+#define CC_PARITY     0xA
+#define CC_LESS       0xC
+#define CC_GREATER_EQ 0xD
+#define CC_LESS_EQ    0xE
+#define CC_GREATER    0xF
+#define CC_ALWAYS     -1
+
+// The condition codes a comparison builtin jumps on, for integers (signed)
+// and for doubles (ucomisd sets the unsigned flags)
+static const struct {
+    PrimitiveFunc func;
+    int int_cc;
+    int double_cc;
+} jit_comparisons[] = {
+    { prim_lt, CC_LESS, CC_BELOW },
+    { prim_gt, CC_GREATER, CC_ABOVE },
+    { prim_lte, CC_LESS_EQ, CC_BELOW_EQ },
+    { prim_gte, CC_GREATER_EQ, CC_ABOVE_EQ },
+    { prim_eq, CC_EQUAL, CC_EQUAL },
+};
+#define JIT_COMPARISON_COUNT (int)(sizeof(jit_comparisons) / sizeof(jit_comparisons[0]))
+
+static void jit_bytes(Jit* j, const char* bytes, int count) {
+    if (j->length + count > j->capacity) {
+        int capacity = j->capacity ? j->capacity * 2 : 256;
+        while (capacity < j->length + count) capacity *= 2;
+        unsigned char* grown = (unsigned char*)realloc(j->code, capacity);
+        if (!grown) out_of_memory();
+        j->code = grown;
+        j->capacity = capacity;
+    }
+    memcpy(j->code + j->length, bytes, count);
+    j->length += count;
+}
+
+// Instruction bytes from a string literal
+#define EMIT(j, bytes) jit_bytes(j, bytes, (int)sizeof(bytes) - 1)
+
+static void jit_int32(Jit* j, int32_t value) {
+    jit_bytes(j, (const char*)&value, 4);
+}
+
+static void jit_int64(Jit* j, int64_t value) {
+    jit_bytes(j, (const char*)&value, 8);
+}
+
+static int32_t jit_read32(Jit* j, int at) {
+    int32_t value;
+    memcpy(&value, j->code + at, 4);
+    return value;
+}
+
+static void jit_write32(Jit* j, int at, int32_t value) {
+    memcpy(j->code + at, &value, 4);
+}
+
+static void jit_jump_opcode(Jit* j, int cc) {
+    if (cc == CC_ALWAYS) {
+        EMIT(j, "\xE9");
+    } else {
+        char op[2] = { 0x0F, (char)(0x80 | cc) };
+        jit_bytes(j, op, 2);
+    }
+}
+
+// Jump to an offset already emitted
+static void jit_jump_back(Jit* j, int cc, int target) {
+    jit_jump_opcode(j, cc);
+    jit_int32(j, target - (j->length + 4));
+}
+
+// Jump to a label not bound yet. A label is the offset of the last jump's
+// rel32 field, each of which holds the previous one until jit_bind() (or
+// -1 with no jumps).
+static void jit_jump(Jit* j, int cc, int* label) {
+    jit_jump_opcode(j, cc);
+    jit_int32(j, *label);
+    *label = j->length - 4;
+}
+
+static void jit_bind(Jit* j, int label) {
+    while (label != -1) {
+        int next = jit_read32(j, label);
+        jit_write32(j, label, j->length - (label + 4));
+        label = next;
+    }
+}
+
+static void jit_bail_if(Jit* j, int cc) {
+    jit_jump_back(j, cc, j->bail);
+}
+
+// Parameters are pushed by the caller, first to last, above the return
+// address and saved rbp
+static int32_t jit_param_offset(Jit* j, int index) {
+    return 16 + 8 * (j->arity - 1 - index);
+}
+
+// The value a free name has now, recording that the code depends on it
+static Sexp* jit_guard(Jit* j, Sexp* ref) {
+    Sexp* value = global_ref_value(ref, j->env);
+    if (isLambda(value) && value->data.lambda.proto == j->proto) {
+        value = NULL;  // Any closure of this lambda runs the same code
+    }
+    for (int i = 0; i < j->guard_count; i++) {
+        if (j->guards[i].ref->data.global.symbol == ref->data.global.symbol) return value;
+    }
+    if (j->guard_count == j->guard_capacity) {
+        int capacity = j->guard_capacity ? j->guard_capacity * 2 : 8;
+        JitGuard* grown = (JitGuard*)realloc(j->guards, capacity * sizeof(JitGuard));
+        if (!grown) out_of_memory();
+        j->guards = grown;
+        j->guard_capacity = capacity;
+    }
+    j->guards[j->guard_count].ref = ref;
+    j->guards[j->guard_count].value = value;
+    j->guard_count++;
+    return value;
+}
+
+// The builtin a call's head is bound to, or NULL
+static PrimitiveFunc jit_primitive(Jit* j, Sexp* head) {
+    if (sexp_type(head) != GLOBAL_REF) return NULL;
+    Sexp* value = jit_guard(j, head);
+    return value && isPrimitive(value) ? value->data.primitive.func : NULL;
+}
+
+static JitType jit_expr(Jit* j, Sexp* form, bool tail);
+
+// The version of a folded form to compile: the folded one, with the
+// builtins it assumed added to the guards checked on entry, or the
+// original if one of them has been rebound already
+static Sexp* jit_unfold(Jit* j, Sexp* form) {
+    while (sexp_type(form) == FOLD_GUARD) {
+        if (!guard_holds(form, j->env)) {
+            form = form->data.guard.original;
+            continue;
+        }
+        for (Sexp* a = form->data.guard.assumed; sexp_is_cons(a); a = cdr(a)) {
+            jit_guard(j, car(car(a)));
+        }
+        form = form->data.guard.folded;
+    }
+    return form;
+}
+
+// Operands a (in rax) and b (in rcx) as doubles in xmm0 and xmm1
+static void jit_doubles(Jit* j, JitType a, JitType b) {
+    if (a == JIT_INT) {
+        EMIT(j, "\xF2\x48\x0F\x2A\xC0");      // cvtsi2sd xmm0, rax
+    } else {
+        EMIT(j, "\x66\x48\x0F\x6E\xC0");      // movq xmm0, rax
+    }
+    if (b == JIT_INT) {
+        EMIT(j, "\xF2\x48\x0F\x2A\xC9");      // cvtsi2sd xmm1, rcx
+    } else {
+        EMIT(j, "\x66\x48\x0F\x6E\xC9");      // movq xmm1, rcx
+    }
+}
+
+// Evaluate a into rax and b into rcx
+static bool jit_operands(Jit* j, Sexp* a, Sexp* b, JitType* ta, JitType* tb) {
+    *ta = jit_expr(j, a, false);
+    if (*ta == JIT_FAIL) return false;
+    EMIT(j, "\x50");                          // push rax
+    *tb = jit_expr(j, b, false);
+    if (*tb == JIT_FAIL) return false;
+    EMIT(j, "\x48\x89\xC1");                  // mov rcx, rax
+    EMIT(j, "\x58");                          // pop rax
+    return true;
+}
+
+// rax = rax op rcx, as add(), sub(), mul(), divide() and mod() would
+static JitType jit_binary(Jit* j, PrimitiveFunc op, JitType a, JitType b) {
+    if (a == JIT_INT && b == JIT_INT) {
+        if (op == prim_add) {
+            EMIT(j, "\x48\x01\xC8");          // add rax, rcx
+            jit_bail_if(j, CC_OVERFLOW);
+        } else if (op == prim_sub) {
+            EMIT(j, "\x48\x29\xC8");          // sub rax, rcx
+            jit_bail_if(j, CC_OVERFLOW);
+        } else if (op == prim_mul) {
+            EMIT(j, "\x48\x0F\xAF\xC1");      // imul rax, rcx
+            jit_bail_if(j, CC_OVERFLOW);
+        } else {
+            // Zero divides are errors; -1 is split out because idiv traps
+            // on INT64_MIN / -1
+            int divide = -1, done = -1;
+            EMIT(j, "\x48\x85\xC9");          // test rcx, rcx
+            jit_bail_if(j, CC_EQUAL);
+            EMIT(j, "\x48\x83\xF9\xFF");      // cmp rcx, -1
+            jit_jump(j, CC_NOT_EQUAL, &divide);
+            if (op == prim_div) {
+                EMIT(j, "\x48\xF7\xD8");      // neg rax
+                jit_bail_if(j, CC_OVERFLOW);
+            } else {
+                EMIT(j, "\x31\xC0");          // xor eax, eax
+            }
+            jit_jump(j, CC_ALWAYS, &done);
+            jit_bind(j, divide);
+            EMIT(j, "\x48\x99");              // cqo
+            EMIT(j, "\x48\xF7\xF9");          // idiv rcx
+            if (op == prim_div) {
+                // An inexact quotient is a double
+                EMIT(j, "\x48\x85\xD2");      // test rdx, rdx
+                jit_bail_if(j, CC_NOT_EQUAL);
+            } else {
+                EMIT(j, "\x48\x89\xD0");      // mov rax, rdx
+            }
+            jit_bind(j, done);
+        }
+        return JIT_INT;
+    }
+
+    jit_doubles(j, a, b);
+    if (op == prim_add) {
+        EMIT(j, "\xF2\x0F\x58\xC1");          // addsd xmm0, xmm1
+    } else if (op == prim_sub) {
+        EMIT(j, "\xF2\x0F\x5C\xC1");          // subsd xmm0, xmm1
+    } else if (op == prim_mul) {
+        EMIT(j, "\xF2\x0F\x59\xC1");          // mulsd xmm0, xmm1
+    } else if (op == prim_div) {
+        EMIT(j, "\x66\x0F\xEF\xD2");          // pxor xmm2, xmm2
+        EMIT(j, "\x66\x0F\x2E\xCA");          // ucomisd xmm1, xmm2
+        jit_bail_if(j, CC_EQUAL);             // Zero, or NaN
+        EMIT(j, "\xF2\x0F\x5E\xC1");          // divsd xmm0, xmm1
+    } else {
+        return JIT_FAIL;                      // fmod has no instruction
+    }
+    EMIT(j, "\x66\x48\x0F\x7E\xC0");          // movq rax, xmm0
+    return JIT_DOUBLE;
+}
+
+// (+ a b ...), (- a ...), (* a b ...), (/ a b ...), (% a b)
+static JitType jit_arithmetic(Jit* j, PrimitiveFunc op, Sexp* args) {
+    int argc = (int)length(args);
+    if (argc == 0 || (argc == 1 && op != prim_sub) || (op == prim_mod && argc != 2)) {
+        return JIT_FAIL;
+    }
+    JitType type = jit_expr(j, car(args), false);
+    if (type == JIT_FAIL) return JIT_FAIL;
+    if (argc == 1) {
+        // (- a) is (- 0 a)
+        if (type == JIT_INT) {
+            EMIT(j, "\x48\xF7\xD8");          // neg rax
+            jit_bail_if(j, CC_OVERFLOW);
+        } else {
+            EMIT(j, "\x66\x48\x0F\x6E\xC8");  // movq xmm1, rax
+            EMIT(j, "\x66\x0F\xEF\xC0");      // pxor xmm0, xmm0
+            EMIT(j, "\xF2\x0F\x5C\xC1");      // subsd xmm0, xmm1
+            EMIT(j, "\x66\x48\x0F\x7E\xC0");  // movq rax, xmm0
+        }
+        return type;
+    }
+    for (args = cdr(args); sexp_is_cons(args); args = cdr(args)) {
+        EMIT(j, "\x50");                      // push rax
+        JitType next = jit_expr(j, car(args), false);
+        if (next == JIT_FAIL) return JIT_FAIL;
+        EMIT(j, "\x48\x89\xC1");              // mov rcx, rax
+        EMIT(j, "\x58");                      // pop rax
+        type = jit_binary(j, op, type, next);
+        if (type == JIT_FAIL) return JIT_FAIL;
+    }
+    return type;
+}
+
+// Jump to label if form's truth is when; fall through otherwise
+static bool jit_test(Jit* j, Sexp* form, bool when, int* label) {
+    form = jit_unfold(j, form);
+    bool truth;
+    if (is_constant(form)) {
+        truth = isTrueSexp(constant_value(form));
+    } else if (sexp_type(form) == GLOBAL_REF) {
+        Sexp* value = jit_guard(j, form);
+        truth = !value || isTrueSexp(value);
+    } else if (sexp_is_cons(form)) {
+        Sexp* head = car(form);
+        Sexp* args = cdr(form);
+        int argc = (int)length(args);
+        if (isSymbol(head)) {
+            // (and a b) and (or a b), as eval reads them
+            SpecialForm kind = symbol_form(head);
+            if ((kind != FORM_AND && kind != FORM_OR) || argc != 2) return false;
+            bool stop = kind == FORM_OR;      // a's truth that decides
+            if (when == stop) {
+                if (!jit_test(j, car(args), stop, label)) return false;
+                return jit_test(j, cadr(args), when, label);
+            }
+            int skip = -1;
+            if (!jit_test(j, car(args), stop, &skip)) return false;
+            if (!jit_test(j, cadr(args), when, label)) return false;
+            jit_bind(j, skip);
+            return true;
+        }
+        PrimitiveFunc func = jit_primitive(j, head);
+        if (func == prim_not && argc == 1) {
+            return jit_test(j, car(args), !when, label);
+        }
+        for (int i = 0; i < JIT_COMPARISON_COUNT; i++) {
+            if (func != jit_comparisons[i].func || argc != 2) continue;
+            JitType a, b;
+            if (!jit_operands(j, car(args), cadr(args), &a, &b)) return false;
+            if (a == JIT_INT && b == JIT_INT) {
+                EMIT(j, "\x48\x39\xC8");      // cmp rax, rcx
+                jit_jump(j, jit_comparisons[i].int_cc ^ !when, label);
+            } else {
+                jit_doubles(j, a, b);
+                EMIT(j, "\x66\x0F\x2E\xC1");  // ucomisd xmm0, xmm1
+                jit_bail_if(j, CC_PARITY);    // Unordered
+                jit_jump(j, jit_comparisons[i].double_cc ^ !when, label);
+            }
+            return true;
+        }
+        return false;
+    } else {
+        return false;
+    }
+    if (truth == when) jit_jump(j, CC_ALWAYS, label);
+    return true;
+}
+
+// A call to the lambda being compiled. In tail position its arguments
+// replace the parameters and the body starts over.
+static JitType jit_self_call(Jit* j, Sexp* args, bool tail) {
+    int argc = 0;
+    for (; sexp_is_cons(args); args = cdr(args), argc++) {
+        if (jit_expr(j, car(args), false) != j->args) return JIT_FAIL;
+        EMIT(j, "\x50");                      // push rax
+    }
+    if (argc != j->arity) return JIT_FAIL;
+    if (tail) {
+        for (int i = argc - 1; i >= 0; i--) {
+            EMIT(j, "\x58");                  // pop rax
+            EMIT(j, "\x48\x89\x85");          // mov [rbp + offset], rax
+            jit_int32(j, jit_param_offset(j, i));
+        }
+        jit_jump_back(j, CC_ALWAYS, j->loop);
+    } else {
+        EMIT(j, "\xE8");                      // call body
+        jit_int32(j, j->body - (j->length + 4));
+        if (argc > 0) {
+            EMIT(j, "\x48\x81\xC4");          // add rsp, 8 * argc
+            jit_int32(j, 8 * argc);
+        }
+    }
+    return j->result;
+}
+
+static JitType jit_if(Jit* j, Sexp* form, bool tail) {
+    if (!sexp_is_cons(cdddr(form))) return JIT_FAIL;  // No else: nil
+    int otherwise = -1, done = -1;
+    if (!jit_test(j, cadr(form), false, &otherwise)) return JIT_FAIL;
+    JitType then = jit_expr(j, caddr(form), tail);
+    jit_jump(j, CC_ALWAYS, &done);
+    jit_bind(j, otherwise);
+    JitType other = jit_expr(j, cadddr(form), tail);
+    jit_bind(j, done);
+    return then == other ? then : JIT_FAIL;
+}
+
+static JitType jit_cond(Jit* j, Sexp* form, bool tail) {
+    JitType type = JIT_FAIL;
+    int done = -1;
+    for (Sexp* c = cdr(form); sexp_is_cons(c); c = cdr(c)) {
+        Sexp* clause = car(c);
+        if (!sexp_is_cons(clause) || !sexp_is_cons(cdr(clause)) || !isNil(cddr(clause))) {
+            return JIT_FAIL;
+        }
+        int next = -1;
+        if (!jit_test(j, car(clause), false, &next)) return JIT_FAIL;
+        JitType value = jit_expr(j, cadr(clause), tail);
+        if (value == JIT_FAIL || (c != cdr(form) && value != type)) return JIT_FAIL;
+        type = value;
+        jit_jump(j, CC_ALWAYS, &done);
+        jit_bind(j, next);
+    }
+    jit_bail_if(j, CC_ALWAYS);                // No clause taken: nil
+    jit_bind(j, done);
+    return type;
+}
+
+// Compile form to leave its value in rax
+static JitType jit_expr(Jit* j, Sexp* form, bool tail) {
+    form = jit_unfold(j, form);
+    if (isInteger(form)) {
+        EMIT(j, "\x48\xB8");                  // mov rax, imm64
+        jit_int64(j, sexp_integer(form));
+        return JIT_INT;
+    }
+    if (isNumber(form)) {
+        double value = sexp_as_double(form);
+        int64_t bits;
+        memcpy(&bits, &value, 8);
+        EMIT(j, "\x48\xB8");                  // mov rax, imm64
+        jit_int64(j, bits);
+        return JIT_DOUBLE;
+    }
+    if (sexp_type(form) == LOCAL_REF) {
+        if (form->data.ref.depth != 0 || form->data.ref.index >= j->arity) return JIT_FAIL;
+        EMIT(j, "\x48\x8B\x85");              // mov rax, [rbp + offset]
+        jit_int32(j, jit_param_offset(j, form->data.ref.index));
+        return j->args;
+    }
+    if (!sexp_is_cons(form)) return JIT_FAIL;
+
+    Sexp* head = car(form);
+    if (isSymbol(head)) {
+        switch (symbol_form(head)) {
+            case FORM_IF:
+                return jit_if(j, form, tail);
+            case FORM_COND:
+                return jit_cond(j, form, tail);
+            default:
+                return JIT_FAIL;
+        }
+    }
+    if (sexp_type(head) != GLOBAL_REF) return JIT_FAIL;
+    Sexp* func = jit_guard(j, head);
+    if (!func) return jit_self_call(j, cdr(form), tail);
+    if (!isPrimitive(func)) return JIT_FAIL;
+    PrimitiveFunc op = func->data.primitive.func;
+    if (op == prim_add || op == prim_sub || op == prim_mul || op == prim_div || op == prim_mod) {
+        return jit_arithmetic(j, op, cdr(form));
+    }
+    return JIT_FAIL;
+}
+
+// Emit the entry stub and body. The stub saves the registers the code
+// uses, keeps its own rsp in r14 so an abandoned run can drop everything
+// at once, pushes the arguments and calls the body. r12 counts the calls
+// the body may still nest; each call takes one and gives it back on return.
+static bool jit_function(Jit* j) {
+    EMIT(j, "\x55");                          // push rbp
+    EMIT(j, "\x41\x54");                      // push r12
+    EMIT(j, "\x41\x55");                      // push r13
+    EMIT(j, "\x41\x56");                      // push r14
+    EMIT(j, "\x41\x57");                      // push r15
+    EMIT(j, "\x49\x89\xE6");                  // mov r14, rsp
+    EMIT(j, "\x49\x89\xF7");                  // mov r15, rsi
+    EMIT(j, "\x49\x89\xD5");                  // mov r13, rdx
+    EMIT(j, "\x49\x89\xCC");                  // mov r12, rcx
+    for (int i = 0; i < j->arity; i++) {
+        EMIT(j, "\x48\x8B\x87");              // mov rax, [rdi + 8 * i]
+        jit_int32(j, 8 * i);
+        EMIT(j, "\x50");                      // push rax
+    }
+    EMIT(j, "\xE8");                          // call body
+    int call = j->length;
+    jit_int32(j, 0);
+    EMIT(j, "\x49\x89\x07");                  // mov [r15], rax
+    EMIT(j, "\xB8\x01\x00\x00\x00");          // mov eax, 1
+    EMIT(j, "\xEB\x02");                      // jmp past the xor
+    j->bail = j->length;
+    EMIT(j, "\x31\xC0");                      // xor eax, eax
+    EMIT(j, "\x4C\x89\xF4");                  // mov rsp, r14
+    EMIT(j, "\x41\x5F");                      // pop r15
+    EMIT(j, "\x41\x5E");                      // pop r14
+    EMIT(j, "\x41\x5D");                      // pop r13
+    EMIT(j, "\x41\x5C");                      // pop r12
+    EMIT(j, "\x5D");                          // pop rbp
+    EMIT(j, "\xC3");                          // ret
+
+    j->body = j->length;
+    jit_write32(j, call, j->body - (call + 4));
+    EMIT(j, "\x55");                          // push rbp
+    EMIT(j, "\x48\x89\xE5");                  // mov rbp, rsp
+    EMIT(j, "\x4C\x39\xEC");                  // cmp rsp, r13
+    jit_bail_if(j, CC_BELOW);
+    EMIT(j, "\x49\x83\xEC\x01");              // sub r12, 1
+    jit_bail_if(j, CC_BELOW);
+    j->loop = j->length;
+    if (jit_expr(j, j->proto->data.proto.body, true) != j->result) return false;
+    EMIT(j, "\x49\x83\xC4\x01");              // add r12, 1
+    EMIT(j, "\xC9");                          // leave
+    EMIT(j, "\xC3");                          // ret
+    return true;
+}
+
+// Native code for func's lambda called with arguments of type args. The
+// result type of calls to itself is unknown until the body is compiled, so
+// the type of the arguments is tried first and then the other one.
+static JitCode* jit_compile(Sexp* func, JitType args) {
+    JitCode* code = (JitCode*)calloc(1, sizeof(JitCode));
+    if (!code) out_of_memory();
+    Sexp* proto = func->data.lambda.proto;
+    for (int attempt = 0; attempt < 2; attempt++) {
+        Jit j = { 0 };
+        j.proto = proto;
+        j.env = func->data.lambda.env;
+        j.arity = proto->data.proto.info->arity;
+        j.args = args;
+        j.result = attempt == 0 ? args : (args == JIT_INT ? JIT_DOUBLE : JIT_INT);
+        if (jit_function(&j)) {
+            void* memory = mmap(NULL, j.length, PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (memory != MAP_FAILED) {
+                memcpy(memory, j.code, j.length);
+                if (mprotect(memory, j.length, PROT_READ | PROT_EXEC) == 0) {
+                    code->entry = (JitEntry)memory;
+                    code->memory = memory;
+                    code->size = j.length;
+                    code->result = j.result;
+                    code->guards = j.guards;
+                    code->guard_count = j.guard_count;
+                    free(j.code);
+                    return code;
+                }
+                munmap(memory, j.length);
+            }
+        }
+        free(j.code);
+        free(j.guards);
+    }
+    return code;
+}
+
+static bool jit_enter(Sexp* func, int argc, Sexp** argv, Sexp** result) {
+    Sexp* proto = func->data.lambda.proto;
+    ProtoInfo* info = proto->data.proto.info;
+    if (info->calls < interp->jit_threshold) {
+        info->calls++;
+        return false;
+    }
+    if (argc != info->arity || argc > JIT_MAX_ARGS) return false;
+
+    JitType type = JIT_INT;
+    if (argc > 0) {
+        if (!isNumber(argv[0])) return false;
+        type = isInteger(argv[0]) ? JIT_INT : JIT_DOUBLE;
+    }
+    int64_t args[JIT_MAX_ARGS];
+    for (int i = 0; i < argc; i++) {
+        if (!isNumber(argv[i]) || isInteger(argv[i]) != (type == JIT_INT)) return false;
+        if (type == JIT_INT) {
+            args[i] = sexp_integer(argv[i]);
+        } else {
+            double value = sexp_as_double(argv[i]);
+            memcpy(&args[i], &value, 8);
+        }
+    }
+
+    JitCode* code = info->jit[type];
+    if (!code) {
+        code = info->jit[type] = jit_compile(func, type);
+    }
+    if (!code->entry) return false;
+    for (int i = 0; i < code->guard_count; i++) {
+        Sexp* value = global_ref_value(code->guards[i].ref, func->data.lambda.env);
+        if (code->guards[i].value ? value != code->guards[i].value
+                                  : !isLambda(value) || value->data.lambda.proto != proto) {
+            return false;
+        }
+    }
+
+    int64_t out;
+    uintptr_t floor = (uintptr_t)__builtin_frame_address(0) - JIT_STACK_BUDGET;
+    uint64_t depth = interp->eval_max_depth ? interp->eval_max_depth : UINT64_MAX;
+    if (!code->entry(args, &out, floor, depth)) {
+        if (++code->bailouts > JIT_MAX_BAILOUTS) code->entry = NULL;
+        return false;
+    }
+    if (code->result == JIT_INT) {
+        *result = make_integer(out);
+    } else {
+        double value;
+        memcpy(&value, &out, 8);
+        *result = make_number(value);
+    }
+    return true;
+}
+
+static void gc_mark_jit(ProtoInfo* info) {
+    for (int v = 0; v < 2; v++) {
+        JitCode* code = info->jit[v];
+        if (!code) continue;
+        for (int i = 0; i < code->guard_count; i++) {
+            if (code->guards[i].value) gc_mark(code->guards[i].value);
+        }
+    }
+}
+
+static void free_jit(ProtoInfo* info) {
+    for (int v = 0; v < 2; v++) {
+        JitCode* code = info->jit[v];
+        if (!code) continue;
+        if (code->memory) munmap(code->memory, code->size);
+        free(code->guards);
+        free(code);
+    }
+}
+
+void jit_configure(size_t threshold) {
+    interp->jit_threshold = threshold;
+}
+
+#else
+
+static bool jit_enter(Sexp* func, int argc, Sexp** argv, Sexp** result) {
+    (void)func; (void)argc; (void)argv; (void)result;
+    return false;
+}
+
+static void gc_mark_jit(ProtoInfo* info) {
+    (void)info;
+}
+
+static void free_jit(ProtoInfo* info) {
+    (void)info;
+}
+
+void jit_configure(size_t threshold) {
+    (void)threshold;  // No native code on this target
+}
+
+#endif
+
+// ============================================================================
+// LIST LIBRARY
+// ============================================================================
+
+// Native list functions: each walks its list in a C loop and builds any
+// result front to back, so the spine comes out contiguous. Functions
+// passed to map/filter/fold are called with their arguments in a C array
+// rather than on the argument stack, which the callee is free to grow.
+
+// Lambdas run on whichever engine is current; primitives go straight in
+static Sexp* call_function(Sexp* func, int argc, Sexp** argv, Sexp* env) {
+    if (interp->current_engine == ENGINE_VM && isLambda(func)) {
+        return vm_apply(func, argc, argv);
+    }
+    if (interp->current_engine == ENGINE_NODES && isLambda(func)) {
+        return node_apply(func, argc, argv);
+    }
+    return apply_argv(func, argc, argv, env);
+}
+
+Sexp* reverse(Sexp* list) {
+    Sexp* result = nil();
+    for (; sexp_is_cons(list); list = cdr(list)) {
+        result = cons(car(list), result);
+    }
+    return result;
+}
+
+// Element n (from 0), or nil past either end
+Sexp* nth(int64_t n, Sexp* list) {
+    if (n < 0) return nil();
+    for (; n > 0 && sexp_is_cons(list); n--) {
+        list = cdr(list);
+    }
+    return sexp_is_cons(list) ? car(list) : nil();
+}
+
+// The first (key . value) pair whose key is eq to key, or nil
+Sexp* assoc(Sexp* key, Sexp* alist) {
+    for (; sexp_is_cons(alist); alist = cdr(alist)) {
+        Sexp* pair = car(alist);
+        if (sexp_is_cons(pair) && eq(car(pair), key)) return pair;
+    }
+    return nil();
+}
+
+// The tail of list starting at the first element eq to x, or nil
+Sexp* member(Sexp* x, Sexp* list) {
+    for (; sexp_is_cons(list); list = cdr(list)) {
+        if (eq(car(list), x)) return list;
+    }
+    return nil();
+}
+
+Sexp* map_list(Sexp* func, Sexp* list, Sexp* env) {
+    Sexp* head = nil();
+    Sexp* tail = NULL;
+    for (; sexp_is_cons(list); list = cdr(list)) {
+        Sexp* arg = car(list);
+        Sexp* cell = cons(call_function(func, 1, &arg, env), nil());
+        if (tail) sexp_cons(tail)->cdr = cell;
+        else head = cell;
+        tail = cell;
+    }
+    return head;
+}
+
+Sexp* filter_list(Sexp* func, Sexp* list, Sexp* env) {
+    Sexp* head = nil();
+    Sexp* tail = NULL;
+    for (; sexp_is_cons(list); list = cdr(list)) {
+        Sexp* arg = car(list);
+        if (isNil(call_function(func, 1, &arg, env))) continue;
+        Sexp* cell = cons(arg, nil());
+        if (tail) sexp_cons(tail)->cdr = cell;
+        else head = cell;
+        tail = cell;
+    }
+    return head;
+}
+
+// Left fold: (func (func (func init x1) x2) x3)
+Sexp* fold_list(Sexp* func, Sexp* init, Sexp* list, Sexp* env) {
+    Sexp* acc = init;
+    for (; sexp_is_cons(list); list = cdr(list)) {
+        Sexp* args[2] = { acc, car(list) };
+        acc = call_function(func, 2, args, env);
+    }
+    return acc;
+}
+
+// ============================================================================
+// HELPER FUNCTIONS
+// ============================================================================
+
+Sexp* atom(const char* str) {
+    // Integer literals are exact; others, and integers too big for 64
+    // bits, fall back to doubles
+    char* endptr;
+    errno = 0;
+    long long ival = strtoll(str, &endptr, 10);
+    if (*endptr == '\0' && str[0] != '\0' && errno == 0) {
+        return make_integer((int64_t)ival);
+    }
+
+    double val = strtod(str, &endptr);
+    if (*endptr == '\0' && str[0] != '\0') {
+        return make_number(val);
+    }
+    
+    // Check if it's a string (starts and ends with quotes)
+    size_t len = strlen(str);
+    if (len >= 2 && str[0] == '"' && str[len-1] == '"') {
+        ScratchMark mark = scratch_mark();
+        char* content = (char*)scratch_alloc(len - 1);
+        memcpy(content, str + 1, len - 2);
+        content[len - 2] = '\0';
+        Sexp* s = make_string(content);
+        scratch_release(mark);
+        return s;
+    }
+    
+    // Otherwise it's a symbol
+    return intern(str);
+}
+
+Sexp* list() {
+    return nil();
+}
+
+Sexp* list1(Sexp* a) {
+    return cons(a, nil());
+}
+
+Sexp* list2(Sexp* a, Sexp* b) {
+    return cons(a, cons(b, nil()));
+}
+
+Sexp* list3(Sexp* a, Sexp* b, Sexp* c) {
+    return cons(a, cons(b, cons(c, nil())));
+}
+
+Sexp* list4(Sexp* a, Sexp* b, Sexp* c, Sexp* d) {
+    return cons(a, cons(b, cons(c, cons(d, nil()))));
+}
+
+Sexp* append(Sexp* list1, Sexp* list2) {
+    if (isNil(list1)) return list2;
+    Sexp* head = cons(car(list1), list2);
+    Sexp* tail = head;
+    for (list1 = cdr(list1); !isNil(list1); list1 = cdr(list1)) {
+        Sexp* cell = cons(car(list1), list2);
+        sexp_cons(tail)->cdr = cell;
+        tail = cell;
+    }
+    return head;
+}
+
+int length(Sexp* list) {
+    int len = 0;
+    while (sexp_is_cons(list)) {
+        len++;
+        list = cdr(list);
+    }
+    return len;
+}
+
+// ============================================================================
+// SIMPLE PARSER
+// ============================================================================
+
+void skip_whitespace(const char** input) {
+    while (**input && isspace(**input)) {
+        (*input)++;
+    }
+}
+
+Sexp* read_atom(const char** input) {
+    const char* start = *input;
+    
+    // Handle strings
+    if (**input == '"') {
+        (*input)++;
+        while (**input && **input != '"') {
+            (*input)++;
+        }
+        if (**input == '"') {
+            (*input)++;
+        }
+    } else {
+        // Handle symbols and numbers
+        while (**input && !isspace(**input) && **input != '(' && **input != ')') {
+            (*input)++;
+        }
+    }
+    
+    size_t len = *input - start;
+    if (len == 0) return nil();
+    
+    // Token text only lives until the next scratch reset
+    char* buffer = (char*)scratch_alloc(len + 1);
+    memcpy(buffer, start, len);
+    buffer[len] = '\0';
+    return atom(buffer);
+}
+
+// The reader keeps the lists it is in the middle of on a stack of its own
+// instead of recursing, so nesting depth is bounded by eval_configure()'s
+// limit rather than the C stack. The stack is a GC root while reading.
+typedef enum {
+    READ_LIST,           // Reading elements of a list
+    READ_DOTTED,         // Reading the tail after " . "
+    READ_QUOTE           // Wrap the next datum in (quote ...)
+} ReadKind;
+
+typedef struct ReadFrame {
+    ReadKind kind;
+    Sexp* head;
+    Sexp* tail;          // Last cell of head; reachable through it
+} ReadFrame;
+
+static void gc_mark_reader(void) {
+    for (size_t i = 0; i < interp->read_top; i++) {
+        gc_mark(interp->read_stack[i].head);
+    }
+}
+
+static bool read_push(ReadKind kind) {
+    if (!depth_available(interp->read_top)) return false;
+    if (interp->read_top == interp->read_capacity) {
+        size_t capacity = interp->read_capacity ? interp->read_capacity * 2 : 64;
+        ReadFrame* grown = (ReadFrame*)realloc(interp->read_stack, capacity * sizeof(ReadFrame));
+        if (!grown) return false;
+        interp->read_stack = grown;
+        interp->read_capacity = capacity;
+    }
+    ReadFrame* f = &interp->read_stack[interp->read_top++];
+    f->kind = kind;
+    f->head = nil();
+    f->tail = nil();
+    return true;
+}
+
+// A dot followed by whitespace or ')' marks a dotted pair
+static bool at_dot(const char* input) {
+    return input[0] == '.' && (input[1] == ')' || isspace((unsigned char)input[1]));
+}
+
+Sexp* read_sexp(const char** input) {
+    size_t base = interp->read_top;
+    Sexp* datum;
+
+    while (1) {
+        // Read the start of a datum: an atom completes at once, an open
+        // paren or quote pushes a frame
+        skip_whitespace(input);
+        if (**input == '\0') {
+            datum = nil();
+        } else if (**input == '(') {
+            (*input)++;  // Skip opening paren
+            skip_whitespace(input);
+            if (**input == ')') {
+                (*input)++;  // Skip closing paren
+                datum = nil();
+            } else {
+                if (!read_push(READ_LIST)) break;
+                continue;
+            }
+        } else if (**input == '\'') {
+            (*input)++;  // Skip quote
+            if (!read_push(READ_QUOTE)) break;
+            continue;
+        } else {
+            datum = read_atom(input);
+        }
+
+        // Hand the datum to the frames it completes
+        bool more = false;
+        while (interp->read_top > base && !more) {
+            ReadFrame* f = &interp->read_stack[interp->read_top - 1];
+            switch (f->kind) {
+                case READ_QUOTE:
+                    interp->read_top--;
+                    datum = list2(intern("quote"), datum);
+                    break;
+
+                case READ_LIST: {
+                    // Built front to back, so the spine is contiguous
+                    Sexp* cell = cons(datum, nil());
+                    if (isNil(f->head)) {
+                        f->head = cell;
+                    } else {
+                        sexp_cons(f->tail)->cdr = cell;
+                    }
+                    f->tail = cell;
+                    skip_whitespace(input);
+                    if (at_dot(*input)) {
+                        (*input)++;  // Skip dot
+                        f->kind = READ_DOTTED;
+                        more = true;
+                    } else if (**input == ')' || **input == '\0') {
+                        if (**input == ')') {
+                            (*input)++;  // Skip closing paren
+                        }
+                        interp->read_top--;
+                        datum = f->head;
+                    } else {
+                        more = true;
+                    }
+                    break;
+                }
+
+                case READ_DOTTED:
+                    sexp_cons(f->tail)->cdr = datum;
+                    skip_whitespace(input);
+                    if (**input == ')') {
+                        (*input)++;
+                    }
+                    interp->read_top--;
+                    datum = f->head;
+                    break;
+            }
+        }
+        if (!more) return datum;
+    }
+
+    // Nested deeper than the stack allows
+    interp->read_top = base;
+    return make_symbol("ERROR:STACK_OVERFLOW");
+}
+
+Sexp* parse(const char* input) {
+    ScratchMark mark = scratch_mark();
+    Sexp* result = read_sexp(&input);
+    scratch_release(mark);
+    return result;
+}
+
+// ============================================================================
+// PRINTING FUNCTIONS
+// ============================================================================
+
+// Nested lists print from an explicit stack of pending work, like the
+// reader, so printing a deep structure doesn't recurse in C. Printing
+// never allocates Sexps, so the stack needs no GC marking.
+typedef enum {
+    PRINT_VALUE,         // Print value
+    PRINT_REST,          // Print the rest of a list whose car is done
+    PRINT_TEXT           // Print text
+} PrintKind;
+
+typedef struct PrintItem {
+    PrintKind kind;
+    Sexp* value;
+    const char* text;
+} PrintItem;
+
+static void print_push(PrintKind kind, Sexp* value, const char* text) {
+    if (interp->print_top == interp->print_capacity) {
+        size_t capacity = interp->print_capacity ? interp->print_capacity * 2 : 64;
+        PrintItem* grown = (PrintItem*)realloc(interp->print_stack, capacity * sizeof(PrintItem));
+        if (!grown) out_of_memory();
+        interp->print_stack = grown;
+        interp->print_capacity = capacity;
+    }
+    PrintItem* item = &interp->print_stack[interp->print_top++];
+    item->kind = kind;
+    item->value = value;
+    item->text = text;
+}
+
+// Print an atom, or push the parts of a compound value (last part first)
+static void print_value(Sexp* s) {
+    if (isNil(s)) {
+        printf("()");
+        return;
+    }
+    
+    switch (sexp_type(s)) {
+        case ATOM_INTEGER:
+            printf("%lld", (long long)sexp_integer(s));
+            break;
+
+        case ATOM_NUMBER:
+            // Whole doubles print without a fraction while they're exact
+            if (fabs(sexp_number(s)) < 1e15 && sexp_number(s) == (double)(long long)sexp_number(s)) {
+                printf("%lld", (long long)sexp_number(s));
+            } else {
+                printf("%g", sexp_number(s));
+            }
+            break;
+            
+        case ATOM_SYMBOL:
+            printf("%s", symbol_name(s));
+            break;
+            
+        case ATOM_STRING:
+            printf("\"%s\"", s->data.string);
+            break;
+            
+        case LAMBDA_TYPE:
+            printf("#<lambda>");
+            break;
+            
+        case LOCAL_REF:
+            print_push(PRINT_VALUE, s->data.ref.symbol, NULL);
+            break;
+            
+        case GLOBAL_REF:
+            print_push(PRINT_VALUE, s->data.global.symbol, NULL);
+            break;
+
+        case FOLD_GUARD:
+            print_push(PRINT_VALUE, s->data.guard.folded, NULL);
+            break;
+            
+        case PROTO_TYPE:
+            printf("(lambda ");
+            print_push(PRINT_TEXT, NULL, ")");
+            print_push(PRINT_VALUE, s->data.proto.body, NULL);
+            print_push(PRINT_TEXT, NULL, " ");
+            print_push(PRINT_VALUE, s->data.proto.params, NULL);
+            break;
+            
+        case FRAME_TYPE:
+        case ENV_TYPE:
+            printf("#<environment>");
+            break;
+            
+        case PRIMITIVE_TYPE:
+            printf("#<primitive>");
+            break;
+
+        case FUTURE_TYPE:
+            printf("#<future>");
+            break;
+            
+        case CONS_CELL:
+            printf("(");
+            print_push(PRINT_REST, sexp_cons(s)->cdr, NULL);
+            print_push(PRINT_VALUE, sexp_cons(s)->car, NULL);
+            break;
+            
+        default:
+            break;
+    }
+}
+
+void print_sexp(Sexp* s) {
+    size_t base = interp->print_top;
+    print_push(PRINT_VALUE, s, NULL);
+    while (interp->print_top > base) {
+        PrintItem item = interp->print_stack[--interp->print_top];
+        switch (item.kind) {
+            case PRINT_VALUE:
+                print_value(item.value);
+                break;
+
+            case PRINT_TEXT:
+                printf("%s", item.text);
+                break;
+
+            case PRINT_REST: {
+                Sexp* rest = item.value;
+                if (!rest || isNil(rest)) {
+                    printf(")");
+                } else if (sexp_type(rest) == CONS_CELL) {
+                    printf(" ");
+                    print_push(PRINT_REST, sexp_cons(rest)->cdr, NULL);
+                    print_push(PRINT_VALUE, sexp_cons(rest)->car, NULL);
+                } else {
+                    // Dotted pair
+                    printf(" . ");
+                    print_push(PRINT_TEXT, NULL, ")");
+                    print_push(PRINT_VALUE, rest, NULL);
+                }
+                break;
+            }
+        }
+    }
+}
+
+void println_sexp(Sexp* s) {
+    print_sexp(s);
+    printf("\n");
+}
+
+// ============================================================================
+// INTERPRETER CONTEXTS
+// ============================================================================
+
+// Every piece of mutable interpreter state lives in struct Interp, and the
+// code reaches it through the thread-local interp, so threads running
+// different Interps share nothing but immutable tables. Values must not
+// cross between Interps: copy them by printing and reading, or rebuild
+// them with the constructors while the receiving Interp is current.
+
+Interp* interp_new(void) {
+    Interp* ctx = (Interp*)malloc(sizeof(Interp));
+    if (!ctx) out_of_memory();
+    interp_init(ctx, interp);
+    return ctx;
+}
+
+Interp* interp_current(void) {
+    return interp;
+}
+
+// The collector scans the stack of the thread it runs on, so an Interp may
+// move between threads as long as one uses it at a time. Entering only
+// switches the thread's current Interp; restoring the previous one with a
+// second call is safe from any thread.
+Interp* interp_enter(Interp* ctx) {
+    Interp* previous = interp;
+    gc_find_stack_bottom();
+    interp = ctx;
+    return previous;
+}
+
+void interp_free(Interp* ctx) {
+    if (!ctx || ctx == &default_interp || ctx == interp) return;
+    Interp* previous = interp;
+    interp = ctx;
+
+    for (SlabPage* page = interp->cell_pages; page; page = page->next) {
+        Sexp* cells = (Sexp*)page_slots(page);
+        for (size_t j = 0; j < page->used && page->owners; j++) {
+            if (cells[j].type != FREE_CELL) release_cell(page, &cells[j]);
+        }
+    }
+    for (size_t i = 0; i < interp->page_count; i++) {
+        page_destroy(interp->page_table[i]);
+    }
+    while (interp->spare_pages) {
+        SlabPage* next = interp->spare_pages->next;
+        page_destroy(interp->spare_pages);
+        interp->spare_pages = next;
+    }
+    while (interp->scratch_chunks) {
+        struct ArenaChunk* next = interp->scratch_chunks->next;
+        free(interp->scratch_chunks);
+        interp->scratch_chunks = next;
+    }
+    while (interp->frame_chunks) {
+        struct FrameChunk* next = interp->frame_chunks->next;
+        free(interp->frame_chunks);
+        interp->frame_chunks = next;
+    }
+    free(interp->spare_frame_chunk);
+    free(interp->page_table);
+    free(interp->gc_roots);
+    free(interp->mark_stack);
+    free(interp->symbol_table);
+    free(interp->arg_stack);
+    free(interp->cont_stack);
+    free(interp->vm_frames);
+    free(interp->read_stack);
+    free(interp->print_stack);
+    pack_release(interp->global_pack);
+
+    interp = previous;
+    free(ctx);
+}
+
+void interp_init_global_env(Interp* ctx) {
+    Interp* previous = interp_enter(ctx);
+    init_global_env();
+    interp = previous;
+}
+
+Sexp* interp_parse(Interp* ctx, const char* input) {
+    Interp* previous = interp_enter(ctx);
+    Sexp* result = parse(input);
+    interp = previous;
+    return result;
+}
+
+Sexp* interp_evaluate(Interp* ctx, Sexp* sexp) {
+    Interp* previous = interp_enter(ctx);
+    Sexp* result = evaluate(sexp, GLOBAL_ENV);
+    interp = previous;
+    return result;
+}
+
+Sexp* global_env(void) {
+    return GLOBAL_ENV;
+}
+
+// ============================================================================
+// PARALLEL EVALUATION
+// ============================================================================
+
+// pmap and futures run on a pool of worker threads, each on an Interp of
+// its own made when the pool starts. No thread ever reads another Interp's
+// heap: what a task needs - the function, its argument, and the caller's
+// global bindings - is packed into a Pack, a flat malloc'd copy that any
+// Interp can unpack into cells of its own, and the result comes back the
+// same way. A closure is packed as its source (see closure_source) and
+// rebuilt by evaluating that in the receiving Interp, so its body is
+// resolved, compiled and specialized there again. Everything a worker
+// sees is a copy: a set or define it runs, of a global or of a captured
+// local, changes its own Interp only and is lost to the caller.
+//
+// Each worker has a deque of tasks. It pops its own newest task and, when
+// out of work, steals the oldest from another worker's deque. The thread
+// that called pmap doesn't sit idle either: it claims its own job's tasks
+// that no worker has taken yet and runs them itself, on the original
+// values, without packing. A task is claimed by one compare-and-swap, so
+// a task is run exactly once whoever gets to it first, and waiting only
+// ever happens on tasks that are already running, which can't deadlock.
+
+typedef enum {
+    PACK_VALUE,       // An immediate, or a static cell such as UNBOUND
+    PACK_NIL,
+    PACK_NUMBER,
+    PACK_INTEGER,
+    PACK_SYMBOL,
+    PACK_STRING,
+    PACK_CONS,
+    PACK_PRIMITIVE,
+    PACK_CLOSURE      // Evaluate the form to rebuild the closure
+} PackKind;
+
+typedef struct {
+    PackKind kind;
+    union {
+        Sexp* value;
+        double number;
+        int64_t integer;
+        size_t text;                    // Offset into the pack's text
+        struct {
+            size_t car;
+            size_t cdr;
+        } pair;
+        struct {
+            PrimitiveFunc func;
+            int min_args;
+            int max_args;
+        } primitive;
+        size_t form;
+    } as;
+} PackItem;
+
+// Items refer to each other by index. A pack is written by one thread and
+// then only read, by any number of them.
+typedef struct Pack {
+    PackItem* items;
+    size_t count;
+    size_t capacity;
+    char* text;
+    size_t text_used;
+    size_t text_capacity;
+    size_t* roots;          // The values packed, in order
+    size_t root_count;
+    size_t root_capacity;
+    unsigned long serial;   // Tells a worker whether it has unpacked this
+    int refs;
+} Pack;
+
+typedef enum {
+    TASK_QUEUED,
+    TASK_TAKEN,
+    TASK_DONE
+} TaskState;
+
+// The tasks of one pmap, or a future's single task
+typedef struct Job {
+    Pack* input;            // Root 0: the function; then its arguments
+    Pack* globals;          // The caller's global bindings
+    unsigned long serial;
+    Engine engine;          // The caller's settings, for the workers
+    size_t jit_calls;
+    size_t remaining;       // Tasks not yet done
+    bool future;
+} Job;
+
+typedef struct Task {
+    Job* job;
+    size_t argument;        // Root in job->input, or 0 for a thunk
+    int state;              // TaskState, read and written atomically
+    Pack* output;           // The result, when a worker ran it
+    int refs;               // Futures: the future cell and a running worker
+} Task;
+
+// A future owns its task and job
+typedef struct {
+    Task task;
+    Job job;
+} Future;
+
+typedef struct Worker {
+    pthread_t thread;
+    pthread_mutex_t lock;   // Guards the deque
+    Task** deque;           // The owner pops at bottom, thieves take from top
+    size_t top;
+    size_t bottom;
+    size_t capacity;
+    Interp* interp;
+    Sexp* function;         // The current job's function, unpacked
+    unsigned long function_serial;
+    unsigned long globals_serial;
+} Worker;
+
+#define POOL_STACK_SIZE ((size_t)8 << 20)
+
+static size_t pool_threads = POOL_DEFAULT_THREADS;
+static bool pool_started = false;      // Set and cleared under pool_start_lock
+static bool pool_stopping = false;     // Tells the workers to exit
+static pthread_mutex_t pool_start_lock = PTHREAD_MUTEX_INITIALIZER;
+static Worker* pool_workers = NULL;
+static size_t pool_slots = 0;           // Workers set up, all before any starts
+static size_t pool_worker_count = 0;    // Of those, the ones running
+static size_t pool_next = 0;            // Round robin for outside pushes
+static size_t pool_queued = 0;          // Deque entries, claimed or not
+static unsigned long pool_serial = 0;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pool_done = PTHREAD_COND_INITIALIZER;
+static _Thread_local Worker* current_worker = NULL;
+
+void pool_configure(size_t threads) {
+    pool_threads = threads;
+}
+
+static unsigned long next_serial(void) {
+    return __atomic_add_fetch(&pool_serial, 1, __ATOMIC_RELAXED);
+}
+
+// --- Packing ---
+
+static Pack* pack_new(void) {
+    Pack* pack = (Pack*)calloc(1, sizeof(Pack));
+    if (!pack) out_of_memory();
+    pack->serial = next_serial();
+    pack->refs = 1;
+    return pack;
+}
+
+static void pack_retain(Pack* pack) {
+    __atomic_add_fetch(&pack->refs, 1, __ATOMIC_RELAXED);
+}
+
+static void pack_release(Pack* pack) {
+    if (!pack || __atomic_sub_fetch(&pack->refs, 1, __ATOMIC_ACQ_REL) > 0) return;
+    free(pack->items);
+    free(pack->text);
+    free(pack->roots);
+    free(pack);
+}
+
+static size_t pack_push(Pack* pack, PackItem item) {
+    if (pack->count == pack->capacity) {
+        size_t capacity = pack->capacity ? pack->capacity * 2 : 64;
+        PackItem* grown = (PackItem*)realloc(pack->items, capacity * sizeof(PackItem));
+        if (!grown) out_of_memory();
+        pack->items = grown;
+        pack->capacity = capacity;
+    }
+    pack->items[pack->count] = item;
+    return pack->count++;
+}
+
+static size_t pack_text(Pack* pack, const char* text) {
+    size_t len = strlen(text) + 1;
+    if (pack->text_used + len > pack->text_capacity) {
+        size_t capacity = pack->text_capacity ? pack->text_capacity * 2 : 256;
+        while (capacity < pack->text_used + len) capacity *= 2;
+        char* grown = (char*)realloc(pack->text, capacity);
+        if (!grown) out_of_memory();
+        pack->text = grown;
+        pack->text_capacity = capacity;
+    }
+    memcpy(pack->text + pack->text_used, text, len);
+    pack->text_used += len;
+    return pack->text_used - len;
+}
+
+static void pack_add_root(Pack* pack, size_t index) {
+    if (pack->root_count == pack->root_capacity) {
+        size_t capacity = pack->root_capacity ? pack->root_capacity * 2 : 16;
+        size_t* grown = (size_t*)realloc(pack->roots, capacity * sizeof(size_t));
+        if (!grown) out_of_memory();
+        pack->roots = grown;
+        pack->root_capacity = capacity;
+    }
+    pack->roots[pack->root_count++] = index;
+}
+
+// Note the value of every local of func's scopes that its body reads, as
+// (name . value) pairs. nesting counts the frames entered inside func, so
+// a reference deeper than that leaves func's own frames.
+static void collect_captures(Sexp* form, int nesting, Sexp* env, Sexp** captured) {
+    if (sexp_type(form) == LOCAL_REF) {
+        int up = form->data.ref.depth - nesting - 1;
+        if (up >= 0 && !sexp_is_cons(assoc(form->data.ref.symbol, *captured))) {
+            Sexp* frame = env;
+            while (up-- > 0) frame = frame->data.frame.parent;
+            Sexp* value = frame->data.frame.slots[form->data.ref.index];
+            *captured = cons(cons(form->data.ref.symbol, value), *captured);
+        }
+        if (form->data.ref.fallback) {
+            collect_captures(form->data.ref.fallback, nesting, env, captured);
+        }
+        return;
+    }
+    if (sexp_type(form) == PROTO_TYPE) {
+        collect_captures(form->data.proto.body, nesting + 1, env, captured);
+        return;
+    }
+    if (sexp_type(form) == FOLD_GUARD) {
+        collect_captures(form->data.guard.folded, nesting, env, captured);
+        collect_captures(form->data.guard.original, nesting, env, captured);
+        return;
+    }
+    if (!sexp_is_cons(form) || is_constant(form)) return;
+
+    // let inits run outside the new frame, let* and letrec inits inside it
+    Sexp* head = car(form);
+    if (isSymbol(head) && sexp_type(cadr(form)) == PROTO_TYPE &&
+        (symbol_form(head) == FORM_LET || symbol_form(head) == FORM_LET_STAR ||
+         symbol_form(head) == FORM_LETREC)) {
+        int inner = symbol_form(head) == FORM_LET ? nesting : nesting + 1;
+        collect_captures(cadr(form), nesting, env, captured);
+        for (Sexp* init = cddr(form); sexp_is_cons(init); init = cdr(init)) {
+            collect_captures(car(init), inner, env, captured);
+        }
+        return;
+    }
+    for (; sexp_is_cons(form); form = cdr(form)) {
+        collect_captures(car(form), nesting, env, captured);
+    }
+}
+
+// A form that rebuilds func in another Interp: its lambda, inside a let
+// binding each captured local to its value now. A local holding func
+// itself, as letrec makes, is bound by a letrec around the lambda.
+static Sexp* closure_source(Sexp* func) {
+    Sexp* proto = func->data.lambda.proto;
+    Sexp* lambda = list3(intern("lambda"), proto->data.proto.params,
+                         unresolve(proto->data.proto.body));
+    Sexp* captured = nil();
+    collect_captures(proto->data.proto.body, 0, func->data.lambda.env, &captured);
+
+    Sexp* bindings = nil();
+    Sexp* self = NULL;
+    for (; sexp_is_cons(captured); captured = cdr(captured)) {
+        Sexp* name = car(car(captured));
+        Sexp* value = cdr(car(captured));
+        if (value == func) {
+            self = name;
+        } else {
+            bindings = cons(list2(name, list2(intern("quote"), value)), bindings);
+        }
+    }
+    Sexp* form = lambda;
+    if (self) form = list3(intern("letrec"), list1(list2(self, lambda)), self);
+    if (!isNil(bindings)) form = list3(intern("let"), bindings, form);
+    return form;
+}
+
+// Pack value and return its index. open lists the closures being packed,
+// so one that captures itself some other way than letrec is an error
+// rather than a loop.
+static size_t pack_value(Pack* pack, Sexp* value, Sexp* open);
+
+static size_t pack_list(Pack* pack, Sexp* list, Sexp* open) {
+    size_t head = 0;
+    size_t last = 0;
+    bool first = true;
+    for (; sexp_is_cons(list); list = cdr(list)) {
+        PackItem item = { .kind = PACK_CONS };
+        item.as.pair.car = pack_value(pack, car(list), open);
+        size_t cell = pack_push(pack, item);
+        if (first) head = cell;
+        else pack->items[last].as.pair.cdr = cell;
+        last = cell;
+        first = false;
+    }
+    size_t rest = pack_value(pack, list, open);
+    pack->items[last].as.pair.cdr = rest;
+    return head;
+}
+
+static size_t pack_value(Pack* pack, Sexp* value, Sexp* open) {
+    if (sexp_is_cons(value)) return pack_list(pack, value, open);
+
+    PackItem item = { .kind = PACK_VALUE };
+    if (isNil(value)) {
+        item.kind = PACK_NIL;
+    } else if (!sexp_is_pointer(value) || value == UNBOUND) {
+        item.as.value = value;
+    } else {
+        switch (value->type) {
+            case ATOM_NUMBER:
+                item.kind = PACK_NUMBER;
+                item.as.number = value->data.number;
+                break;
+            case ATOM_INTEGER:
+                item.kind = PACK_INTEGER;
+                item.as.integer = value->data.integer;
+                break;
+            case ATOM_SYMBOL:
+                item.kind = PACK_SYMBOL;
+                item.as.text = pack_text(pack, symbol_name(value));
+                break;
+            case ATOM_STRING:
+                item.kind = PACK_STRING;
+                item.as.text = pack_text(pack, value->data.string);
+                break;
+            case PRIMITIVE_TYPE:
+                item.kind = PACK_PRIMITIVE;
+                item.as.primitive.func = value->data.primitive.func;
+                item.as.primitive.min_args = value->data.primitive.min_args;
+                item.as.primitive.max_args = value->data.primitive.max_args;
+                break;
+            case LAMBDA_TYPE:
+                if (sexp_is_cons(member(value, open))) {
+                    item.kind = PACK_SYMBOL;
+                    item.as.text = pack_text(pack, "ERROR:CYCLIC_CLOSURE");
+                    break;
+                }
+                item.kind = PACK_CLOSURE;
+                item.as.form = pack_value(pack, closure_source(value), cons(value, open));
+                break;
+            default:
+                // Environments, templates and futures stay in their Interp
+                item.kind = PACK_SYMBOL;
+                item.as.text = pack_text(pack, "ERROR:NOT_TRANSFERABLE");
+                break;
+        }
+    }
+    return pack_push(pack, item);
+}
+
+// --- Unpacking, into the current Interp ---
+
+static Sexp* unpack(const Pack* pack, size_t index);
+
+// Built front to back, like the list library's results
+static Sexp* unpack_list(const Pack* pack, size_t index) {
+    Sexp* head = nil();
+    Sexp* tail = NULL;
+    for (; pack->items[index].kind == PACK_CONS; index = pack->items[index].as.pair.cdr) {
+        Sexp* cell = cons(unpack(pack, pack->items[index].as.pair.car), nil());
+        if (tail) sexp_cons(tail)->cdr = cell;
+        else head = cell;
+        tail = cell;
+    }
+    if (tail && pack->items[index].kind != PACK_NIL) {
+        Sexp* rest = unpack(pack, index);
+        sexp_cons(tail)->cdr = rest;
+    }
+    return head;
+}
+
+static Sexp* unpack(const Pack* pack, size_t index) {
+    const PackItem* item = &pack->items[index];
+    switch (item->kind) {
+        case PACK_VALUE:
+            return item->as.value;
+        case PACK_NIL:
+            return nil();
+        case PACK_NUMBER:
+            return make_number(item->as.number);
+        case PACK_INTEGER:
+            return make_integer(item->as.integer);
+        case PACK_SYMBOL:
+            return intern(pack->text + item->as.text);
+        case PACK_STRING:
+            return make_string(pack->text + item->as.text);
+        case PACK_CONS:
+            return unpack_list(pack, index);
+        case PACK_PRIMITIVE:
+            return make_primitive_arity(item->as.primitive.func,
+                                        item->as.primitive.min_args,
+                                        item->as.primitive.max_args);
+        case PACK_CLOSURE:
+            return eval(unpack(pack, item->as.form), GLOBAL_ENV);
+    }
+    return nil();
+}
+
+// --- Global bindings ---
+
+// The current Interp's global bindings as a pack of name, value, name,
+// value... Repacked only when a binding has changed since the last time:
+// global_snapshot keeps the names and values packed then, which also stops
+// their cells being reused for something else in between.
+static Pack* pack_globals(void) {
+    EnvTable* table = GLOBAL_ENV->data.env.table;
+
+    Sexp* snapshot = interp->global_snapshot;
+    bool same = interp->global_pack != NULL;
+    for (size_t i = 0; same && i < table->capacity; i++) {
+        EnvBinding* b = &table->bindings[i];
+        if (!b->symbol) continue;
+        same = sexp_is_cons(snapshot) && car(snapshot) == b->symbol &&
+               car(cdr(snapshot)) == b->value;
+        snapshot = same ? cddr(snapshot) : snapshot;
+    }
+    if (same && isNil(snapshot)) return interp->global_pack;
+
+    Pack* pack = pack_new();
+    Sexp* kept = nil();
+    for (size_t i = table->capacity; i > 0; i--) {
+        EnvBinding* b = &table->bindings[i - 1];
+        if (!b->symbol) continue;
+        kept = cons(b->symbol, cons(b->value, kept));
+    }
+    for (Sexp* p = kept; sexp_is_cons(p); p = cddr(p)) {
+        pack_add_root(pack, pack_value(pack, car(p), nil()));
+        pack_add_root(pack, pack_value(pack, cadr(p), nil()));
+    }
+    pack_release(interp->global_pack);
+    interp->global_pack = pack;
+    interp->global_snapshot = kept;
+    return pack;
+}
+
+// Bind the packed globals in the current Interp. Closures come last, once
+// the data and builtins they may fold against are in place; names they
+// will take are cleared first, so a builtin a user function replaces is
+// never folded into another body.
+static void unpack_globals(const Pack* pack) {
+    for (int pass = 0; pass < 3; pass++) {
+        for (size_t i = 0; i + 1 < pack->root_count; i += 2) {
+            bool closure = pack->items[pack->roots[i + 1]].kind == PACK_CLOSURE;
+            if (closure != (pass != 1)) continue;
+            Sexp* name = unpack(pack, pack->roots[i]);
+            env_set(GLOBAL_ENV, name, pass == 0 ? nil() : unpack(pack, pack->roots[i + 1]));
+        }
+    }
+}
+
+// --- The pool ---
+
+static void deque_push(Worker* w, Task* task) {
+    pthread_mutex_lock(&w->lock);
+    if (w->bottom == w->capacity) {
+        if (w->top > 0) {
+            memmove(w->deque, w->deque + w->top, (w->bottom - w->top) * sizeof(Task*));
+            w->bottom -= w->top;
+            w->top = 0;
+        } else {
+            size_t capacity = w->capacity ? w->capacity * 2 : 256;
+            Task** grown = (Task**)realloc(w->deque, capacity * sizeof(Task*));
+            if (!grown) out_of_memory();
+            w->deque = grown;
+            w->capacity = capacity;
+        }
+    }
+    w->deque[w->bottom++] = task;
+    pthread_mutex_unlock(&w->lock);
+    __atomic_add_fetch(&pool_queued, 1, __ATOMIC_RELEASE);
+}
+
+static bool task_claim(Task* task) {
+    int expected = TASK_QUEUED;
+    return __atomic_compare_exchange_n(&task->state, &expected, TASK_TAKEN, false,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+// Take a task from w's deque, newest first for its owner and oldest first
+// for a thief. Entries someone else has claimed are dropped on the way.
+// Claiming under the lock means a task is never touched again once
+// pool_withdraw has taken its job's entries out.
+static Task* deque_take(Worker* w, bool newest) {
+    Task* found = NULL;
+    pthread_mutex_lock(&w->lock);
+    while (!found && w->bottom > w->top) {
+        Task* task = newest ? w->deque[--w->bottom] : w->deque[w->top++];
+        __atomic_sub_fetch(&pool_queued, 1, __ATOMIC_RELAXED);
+        if (task_claim(task)) {
+            if (task->job->future) task->refs++;
+            found = task;
+        }
+    }
+    if (w->top == w->bottom) w->top = w->bottom = 0;
+    pthread_mutex_unlock(&w->lock);
+    return found;
+}
+
+// Take job's entries out of every deque
+static void pool_withdraw(Job* job) {
+    for (size_t i = 0; i < pool_worker_count; i++) {
+        Worker* w = &pool_workers[i];
+        pthread_mutex_lock(&w->lock);
+        size_t kept = w->top;
+        for (size_t j = w->top; j < w->bottom; j++) {
+            if (w->deque[j]->job != job) w->deque[kept++] = w->deque[j];
+        }
+        __atomic_sub_fetch(&pool_queued, w->bottom - kept, __ATOMIC_RELAXED);
+        w->bottom = kept;
+        pthread_mutex_unlock(&w->lock);
+    }
+}
+
+static void pool_signal(pthread_cond_t* cond) {
+    pthread_mutex_lock(&pool_lock);
+    pthread_cond_broadcast(cond);
+    pthread_mutex_unlock(&pool_lock);
+}
+
+// The next task for w, or NULL once the pool is shutting down
+static Task* worker_next_task(Worker* w) {
+    size_t index = (size_t)(w - pool_workers);
+    while (1) {
+        if (__atomic_load_n(&pool_stopping, __ATOMIC_ACQUIRE)) return NULL;
+        Task* task = deque_take(w, true);
+        for (size_t i = 1; !task && i < pool_slots; i++) {
+            task = deque_take(&pool_workers[(index + i) % pool_slots], false);
+        }
+        if (task) return task;
+
+        pthread_mutex_lock(&pool_lock);
+        while (__atomic_load_n(&pool_queued, __ATOMIC_ACQUIRE) == 0 &&
+               !__atomic_load_n(&pool_stopping, __ATOMIC_ACQUIRE)) {
+            pthread_cond_wait(&pool_work, &pool_lock);
+        }
+        pthread_mutex_unlock(&pool_lock);
+    }
+}
+
+static void task_release(Task* task) {
+    if (__atomic_sub_fetch(&task->refs, 1, __ATOMIC_ACQ_REL) > 0) return;
+    pack_release(task->job->input);
+    pack_release(task->job->globals);
+    pack_release(task->output);
+    free(task);   // The Future the task sits at the start of
+}
+
+static void worker_run(Worker* w, Task* task) {
+    Job* job = task->job;
+    bool future = job->future;
+
+    interp->current_engine = job->engine;
+    interp->jit_threshold = job->jit_calls;
+    if (w->globals_serial != job->globals->serial) {
+        unpack_globals(job->globals);
+        w->globals_serial = job->globals->serial;
+    }
+    if (w->function_serial != job->serial) {
+        w->function = unpack(job->input, job->input->roots[0]);
+        w->function_serial = job->serial;
+    }
+
+    Sexp* argument = NULL;
+    int argc = 0;
+    if (task->argument) {
+        argument = unpack(job->input, job->input->roots[task->argument]);
+        argc = 1;
+    }
+    Sexp* result = call_function(w->function, argc, &argument, GLOBAL_ENV);
+
+    Pack* output = pack_new();
+    pack_add_root(output, pack_value(output, result, nil()));
+    task->output = output;
+    heap_reset_scratch();
+
+    // Once remaining reaches 0 the caller may free the job and its tasks
+    __atomic_store_n(&task->state, TASK_DONE, __ATOMIC_RELEASE);
+    if (future) {
+        pool_signal(&pool_done);
+        task_release(task);
+    } else if (__atomic_sub_fetch(&job->remaining, 1, __ATOMIC_ACQ_REL) == 0) {
+        pool_signal(&pool_done);
+    }
+}
+
+static void* worker_main(void* arg) {
+    Worker* w = (Worker*)arg;
+    current_worker = w;
+    interp_enter(w->interp);
+    init_global_env();
+    gc_register_root(&w->function);
+    for (Task* task; (task = worker_next_task(w)); ) {
+        worker_run(w, task);
+    }
+    return NULL;
+}
+
+// Cores online, or 1 if that can't be found out
+static size_t online_cores(void) {
+#if defined(_SC_NPROCESSORS_ONLN)
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+#elif defined(_WIN32)
+    // MinGW has no sysconf for this; Windows sets it for every process
+    const char* count = getenv("NUMBER_OF_PROCESSORS");
+    long cores = count ? strtol(count, NULL, 10) : 0;
+#else
+    long cores = 0;
+#endif
+    return cores > 0 ? (size_t)cores : 1;
+}
+
+static void pool_start(void) {
+    size_t threads = pool_threads;
+    if (threads == 0) threads = online_cores();
+    if (threads <= 1) return;
+
+    pool_workers = (Worker*)calloc(threads - 1, sizeof(Worker));
+    if (!pool_workers) out_of_memory();
+    pool_slots = threads - 1;
+    for (size_t i = 0; i < pool_slots; i++) {
+        pthread_mutex_init(&pool_workers[i].lock, NULL);
+        pool_workers[i].interp = interp_new();
+    }
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setstacksize(&attr, POOL_STACK_SIZE);
+    // Workers that fail to start leave empty deques the rest look through
+    for (size_t i = 0; i < pool_slots; i++) {
+        Worker* w = &pool_workers[i];
+        if (pthread_create(&w->thread, &attr, worker_main, w) != 0) break;
+        pool_worker_count++;
+    }
+    pthread_attr_destroy(&attr);
+
+    static bool registered = false;
+    if (!registered) {
+        atexit(pool_shutdown);
+        registered = true;
+    }
+}
+
+// Whether there are workers to hand tasks to, starting the pool if needed
+static bool pool_ready(void) {
+    if (!__atomic_load_n(&pool_started, __ATOMIC_ACQUIRE)) {
+        pthread_mutex_lock(&pool_start_lock);
+        if (!pool_started) {
+            pool_start();
+            __atomic_store_n(&pool_started, true, __ATOMIC_RELEASE);
+        }
+        pthread_mutex_unlock(&pool_start_lock);
+    }
+    return pool_worker_count > 0;
+}
+
+// Stop the workers and free their Interps. Tasks already running finish
+// first; futures still queued are left to their touch, which runs them on
+// the caller. A later pmap or future starts the pool again. Runs at exit,
+// and must not be called while a pmap is in progress.
+void pool_shutdown(void) {
+    if (current_worker) return;   // exit() from inside a task
+    pthread_mutex_lock(&pool_start_lock);
+    if (pool_started) {
+        pthread_mutex_lock(&pool_lock);
+        __atomic_store_n(&pool_stopping, true, __ATOMIC_RELEASE);
+        pthread_cond_broadcast(&pool_work);
+        pthread_mutex_unlock(&pool_lock);
+        for (size_t i = 0; i < pool_worker_count; i++) {
+            pthread_join(pool_workers[i].thread, NULL);
+        }
+        for (size_t i = 0; i < pool_slots; i++) {
+            Worker* w = &pool_workers[i];
+            interp_free(w->interp);
+            free(w->deque);
+            pthread_mutex_destroy(&w->lock);
+        }
+        free(pool_workers);
+        pool_workers = NULL;
+        pool_slots = 0;
+        pool_worker_count = 0;
+        pool_queued = 0;
+        __atomic_store_n(&pool_stopping, false, __ATOMIC_RELEASE);
+        __atomic_store_n(&pool_started, false, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&pool_start_lock);
+}
+
+static void job_init(Job* job, Pack* input, bool future) {
+    job->input = input;
+    job->globals = pack_globals();
+    pack_retain(job->globals);
+    job->serial = next_serial();
+    job->engine = interp->current_engine;
+    job->jit_calls = interp->jit_threshold;
+    job->future = future;
+}
+
+// Wait until a worker has finished a task it claimed
+static void wait_for(const Task* task) {
+    pthread_mutex_lock(&pool_lock);
+    while (__atomic_load_n(&task->state, __ATOMIC_ACQUIRE) != TASK_DONE) {
+        pthread_cond_wait(&pool_done, &pool_lock);
+    }
+    pthread_mutex_unlock(&pool_lock);
+}
+
+// --- pmap ---
+
+// Map func over list on the pool. Each worker is handed a block of the
+// elements, its first element on top of its deque; the caller meanwhile
+// works from the last element back.
+Sexp* pmap_list(Sexp* func, Sexp* list, Sexp* env) {
+    size_t count = (size_t)length(list);
+    if (count < 2 || !pool_ready()) return map_list(func, list, env);
+
+    Sexp** items = (Sexp**)malloc(count * sizeof(Sexp*));
+    Sexp** cells = (Sexp**)malloc(count * sizeof(Sexp*));
+    Task* tasks = (Task*)calloc(count, sizeof(Task));
+    Job* job = (Job*)calloc(1, sizeof(Job));   // Off the stack the GC scans
+    if (!items || !cells || !tasks || !job) out_of_memory();
+
+    // The results go into a list made up front, filled in as tasks finish
+    Sexp* results = nil();
+    for (size_t i = count; i > 0; i--) {
+        results = cons(nil(), results);
+    }
+    Sexp* p = list;
+    Sexp* r = results;
+    for (size_t i = 0; i < count; i++, p = cdr(p), r = cdr(r)) {
+        items[i] = car(p);
+        cells[i] = r;
+    }
+
+    Pack* input = pack_new();
+    pack_add_root(input, pack_value(input, func, nil()));
+    for (size_t i = 0; i < count; i++) {
+        pack_add_root(input, pack_value(input, items[i], nil()));
+    }
+    job_init(job, input, false);
+    job->remaining = count;
+
+    size_t block = (count + pool_worker_count - 1) / pool_worker_count;
+    for (size_t w = 0; w < pool_worker_count; w++) {
+        size_t lo = w * block;
+        size_t hi = lo + block < count ? lo + block : count;
+        for (size_t i = hi; i > lo; i--) {
+            tasks[i - 1].job = job;
+            tasks[i - 1].argument = i;
+            deque_push(&pool_workers[w], &tasks[i - 1]);
+        }
+    }
+    pool_signal(&pool_work);
+
+    for (size_t i = count; i > 0; i--) {
+        if (!task_claim(&tasks[i - 1])) continue;
+        Sexp* arg = items[i - 1];
+        sexp_cons(cells[i - 1])->car = call_function(func, 1, &arg, env);
+        __atomic_store_n(&tasks[i - 1].state, TASK_DONE, __ATOMIC_RELEASE);
+        __atomic_sub_fetch(&job->remaining, 1, __ATOMIC_ACQ_REL);
+    }
+    pool_withdraw(job);
+
+    pthread_mutex_lock(&pool_lock);
+    while (__atomic_load_n(&job->remaining, __ATOMIC_ACQUIRE) > 0) {
+        pthread_cond_wait(&pool_done, &pool_lock);
+    }
+    pthread_mutex_unlock(&pool_lock);
+
+    for (size_t i = 0; i < count; i++) {
+        Pack* output = tasks[i].output;
+        if (!output) continue;
+        Sexp* value = unpack(output, output->roots[0]);
+        sexp_cons(cells[i])->car = value;
+        pack_release(output);
+    }
+    pack_release(input);
+    pack_release(job->globals);
+    free(job);
+    free(tasks);
+    free(cells);
+    free(items);
+    return results;
+}
+
+Sexp* prim_pmap(int argc, Sexp** argv, Sexp* env) {
+    (void)argc;
+    Sexp* func = argv[0];
+    Sexp* list = argv[1];
+    if (!isFunction(func)) return make_symbol("ERROR:NOT_A_FUNCTION");
+    if (!isList(list)) return make_symbol("ERROR:NOT_A_LIST");
+    return pmap_list(func, list, env);
+}
+
+// --- Futures ---
+
+// (future-call thunk), which (future expr) expands to: start calling thunk
+// on the pool. Without workers it waits for touch.
+Sexp* prim_future_call(int argc, Sexp** argv, Sexp* env) {
+    (void)argc;
+    (void)env;
+    Sexp* thunk = argv[0];
+    if (!isFunction(thunk)) return make_symbol("ERROR:NOT_A_FUNCTION");
+
+    Future* future = (Future*)calloc(1, sizeof(Future));
+    if (!future) out_of_memory();
+    Task* task = &future->task;
+    task->job = &future->job;
+    task->refs = 1;
+    future->job.future = true;
+
+    Sexp* s = allocate_sexp();
+    s->type = FUTURE_TYPE;
+    s->data.future.task = task;
+    s->data.future.value = thunk;
+    page_of(s)->owners++;
+
+    if (pool_ready()) {
+        Pack* input = pack_new();
+        pack_add_root(input, pack_value(input, thunk, nil()));
+        job_init(&future->job, input, true);
+        Worker* w = current_worker;
+        if (!w) {
+            size_t next = __atomic_fetch_add(&pool_next, 1, __ATOMIC_RELAXED);
+            w = &pool_workers[next % pool_worker_count];
+        }
+        deque_push(w, task);
+        pool_signal(&pool_work);
+    }
+    return s;
+}
+
+// Drop the future cell's hold on its task, taking it off the pool if no
+// worker has started it
+static void future_release(Task* task) {
+    if (task->job->input) pool_withdraw(task->job);
+    task_release(task);
+}
+
+// (touch f): f's value, running it here if no worker has started it yet
+Sexp* prim_touch(int argc, Sexp** argv, Sexp* env) {
+    (void)argc;
+    Sexp* s = argv[0];
+    if (sexp_type(s) != FUTURE_TYPE) return s;
+    Task* task = s->data.future.task;
+    if (!task) return s->data.future.value;
+
+    Sexp* value;
+    if (task_claim(task)) {
+        value = call_function(s->data.future.value, 0, NULL, env);
+    } else {
+        wait_for(task);
+        value = unpack(task->output, task->output->roots[0]);
+    }
+    if (s->data.future.task) {
+        s->data.future.task = NULL;
+        s->data.future.value = value;
+        future_release(task);
+    }
+    return s->data.future.value;
+}
@@ -1,169 +1,525 @@
-// lisp_interpreter.h
-// Oliver Skoczylas - CWID: 12281473
-// Header file for LISP interpreter - Sprints 1-8
-
-#ifndef LISP_INTERPRETER_H
-#define LISP_INTERPRETER_H
-
-#include <stdbool.h>
-
-// ============================================================================
-// TYPE DEFINITIONS
-// ============================================================================
-
-typedef enum {
-    ATOM_NUMBER,
-    ATOM_SYMBOL,
-    ATOM_STRING,
-    CONS_CELL,
-    NIL_TYPE,
-    LAMBDA_TYPE,
-    PRIMITIVE_TYPE
-} SexpType;
-
-typedef struct Sexp Sexp;
-typedef Sexp* (*PrimitiveFunc)(Sexp*, Sexp*);
-
-struct Sexp {
-    SexpType type;
-    union {
-        double number;
-        char* symbol;
-        char* string;
-        struct {
-            Sexp* car;
-            Sexp* cdr;
-        } cons;
-        struct {
-            Sexp* params;
-            Sexp* body;
-            Sexp* env;
-        } lambda;
-        PrimitiveFunc primitive;
-    } data;
-};
-
-// ============================================================================
-// GLOBAL CONSTANTS
-// ============================================================================
-
-extern Sexp* NIL;
-extern Sexp* TRUE_SEXP;
-extern Sexp* GLOBAL_ENV;
-
-// ============================================================================
-// MEMORY MANAGEMENT
-// ============================================================================
-
-Sexp* allocate_sexp(void);
-
-// ============================================================================
-// CONSTRUCTORS
-// ============================================================================
-
-Sexp* nil(void);
-Sexp* make_number(double value);
-Sexp* make_symbol(const char* value);
-Sexp* make_string(const char* value);
-Sexp* cons(Sexp* car, Sexp* cdr);
-Sexp* make_lambda(Sexp* params, Sexp* body, Sexp* env);
-Sexp* make_primitive(PrimitiveFunc func);
-
-// ============================================================================
-// PREDICATES
-// ============================================================================
-
-bool isNil(Sexp* s);
-bool isNumber(Sexp* s);
-bool isSymbol(Sexp* s);
-bool isString(Sexp* s);
-bool isList(Sexp* s);
-bool isTrueSexp(Sexp* s);
-bool isLambda(Sexp* s);
-bool isPrimitive(Sexp* s);
-
-// ============================================================================
-// ACCESSORS
-// ============================================================================
-
-Sexp* car(Sexp* s);
-Sexp* cdr(Sexp* s);
-Sexp* cadr(Sexp* s);
-Sexp* caddr(Sexp* s);
-Sexp* cadddr(Sexp* s);
-
-// ============================================================================
-// ADDITIONAL FUNCTIONS
-// ============================================================================
-
-bool eq(Sexp* a, Sexp* b);
-bool null(Sexp* s);
-
-// ============================================================================
-// ARITHMETIC FUNCTIONS
-// ============================================================================
-
-Sexp* add(Sexp* a, Sexp* b);
-Sexp* sub(Sexp* a, Sexp* b);
-Sexp* mul(Sexp* a, Sexp* b);
-Sexp* divide(Sexp* a, Sexp* b);
-Sexp* mod(Sexp* a, Sexp* b);
-
-// ============================================================================
-// COMPARISON FUNCTIONS
-// ============================================================================
-
-Sexp* lt(Sexp* a, Sexp* b);
-Sexp* gt(Sexp* a, Sexp* b);
-Sexp* lte(Sexp* a, Sexp* b);
-Sexp* gte(Sexp* a, Sexp* b);
-Sexp* not(Sexp* s);
-
-// ============================================================================
-// ENVIRONMENT FUNCTIONS
-// ============================================================================
-
-Sexp* make_env(Sexp* symbols, Sexp* values, Sexp* parent);
-Sexp* env_symbols(Sexp* env);
-Sexp* env_values(Sexp* env);
-Sexp* env_parent(Sexp* env);
-Sexp* env_set(Sexp* env, Sexp* symbol, Sexp* value);
-Sexp* env_lookup(Sexp* env, Sexp* symbol);
-void init_global_env(void);
-
-// ============================================================================
-// EVAL FUNCTION
-// ============================================================================
-
-Sexp* eval(Sexp* sexp, Sexp* env);
-Sexp* eval_list(Sexp* list, Sexp* env);
-Sexp* apply(Sexp* func, Sexp* args, Sexp* env);
-
-// ============================================================================
-// HELPER FUNCTIONS
-// ============================================================================
-
-Sexp* atom(const char* str);
-Sexp* list(void);
-Sexp* list1(Sexp* a);
-Sexp* list2(Sexp* a, Sexp* b);
-Sexp* list3(Sexp* a, Sexp* b, Sexp* c);
-Sexp* list4(Sexp* a, Sexp* b, Sexp* c, Sexp* d);
-Sexp* append(Sexp* list1, Sexp* list2);
-int length(Sexp* list);
-
-// ============================================================================
-// PRINTING FUNCTIONS
-// ============================================================================
-
-void print_sexp(Sexp* s);
-void println_sexp(Sexp* s);
-
-// ============================================================================
-// PARSER FUNCTIONS
-// ============================================================================
-
-Sexp* parse(const char* input);
-Sexp* read_sexp(const char** input);
-
+// lisp_interpreter.h
+// Oliver Skoczylas - CWID: 12281473
+// Header file for LISP interpreter - Sprints 1-8
+
+#ifndef LISP_INTERPRETER_H
+#define LISP_INTERPRETER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// ============================================================================
+// TYPE DEFINITIONS
+// ============================================================================
+
+typedef enum {
+    ATOM_NUMBER,
+    ATOM_INTEGER,    // Exact 64-bit integer (fixnum or boxed)
+    ATOM_SYMBOL,
+    ATOM_STRING,
+    CONS_CELL,
+    NIL_TYPE,
+    LAMBDA_TYPE,
+    PRIMITIVE_TYPE,
+    ENV_TYPE,        // Hash-table environment frame (the global frame)
+    PROTO_TYPE,      // Lambda template: params, resolved body, frame size
+    FRAME_TYPE,      // Lambda call frame: an array of slots
+    LOCAL_REF,       // Resolved local variable reference (depth, slot)
+    GLOBAL_REF,      // Resolved free variable reference with an inline cache
+    FOLD_GUARD,      // Folded form, its original and the builtins assumed
+    FUTURE_TYPE,     // Value of (future expr), running or touched
+    FREE_CELL        // Heap cell sitting on the collector's free list
+} SexpType;
+
+// Special-form tags stored on symbols, so eval can dispatch without strcmp
+typedef enum {
+    FORM_NONE,
+    FORM_QUOTE,
+    FORM_SET,
+    FORM_DEFINE,
+    FORM_LAMBDA,
+    FORM_IF,
+    FORM_AND,
+    FORM_OR,
+    FORM_COND,
+    FORM_BEGIN,
+    FORM_LET,
+    FORM_LET_STAR,
+    FORM_LETREC,
+    FORM_WHILE,
+    FORM_DO,
+    FORM_FUTURE
+} SpecialForm;
+
+typedef struct Sexp Sexp;
+
+// Cons cells have a layout of their own: just {car, cdr}, 16 bytes on
+// 64-bit targets, with mark bits kept in a bitmap on the cell's slab page.
+// A Sexp* to a cons has SEXP_CONS_TAG set in its low bit; sexp_cons()
+// strips it.
+typedef struct ConsCell {
+    Sexp* car;
+    Sexp* cdr;
+} ConsCell;
+
+#define SEXP_CONS_TAG ((uintptr_t)1)
+
+// Primitives get their arguments as an array: (argc, argv, env)
+typedef Sexp* (*PrimitiveFunc)(int, Sexp**, Sexp*);
+
+// max_args for a primitive taking any number of arguments from min_args up
+#define ARITY_VARIADIC -1
+
+struct Sexp {
+    SexpType type;
+    bool marked;     // Set by the garbage collector during marking
+    unsigned char form;  // SpecialForm tag (symbols only)
+    union {
+        double number;
+        int64_t integer;
+        char* symbol;
+        char* string;
+        struct {
+            Sexp* proto;
+            Sexp* env;
+        } lambda;
+        struct {
+            Sexp* params;
+            Sexp* body;      // Body with local references resolved
+            struct ProtoInfo* info;  // Frame layout and compiled bytecode
+        } proto;
+        struct {
+            Sexp** slots;
+            Sexp* parent;
+            Sexp* proto;
+        } frame;
+        struct {
+            Sexp* symbol;
+            Sexp* fallback;  // Evaluated instead while the slot is unbound
+            int depth;       // Frames to walk up from the current one
+            int index;
+        } ref;
+        struct {
+            Sexp* symbol;
+            struct EnvBinding* binding;  // Cached global binding
+            size_t version;  // global_version the cache was filled at
+        } global;
+        struct {
+            Sexp* folded;
+            Sexp* original;  // Run instead once an assumption fails
+            Sexp* assumed;   // ((GLOBAL_REF . builtin)...)
+        } guard;
+        struct {
+            PrimitiveFunc func;
+            int min_args;    // Checked by the caller before func runs
+            int max_args;    // Or ARITY_VARIADIC
+        } primitive;
+        struct {
+            struct EnvTable* table;
+            Sexp* parent;
+        } env;
+        struct {
+            struct Task* task;   // NULL once touched
+            Sexp* value;         // The thunk until touched, then its result
+        } future;
+        Sexp* next_free;     // FREE_CELL: next cell on the free list
+    } data;
+};
+
+// ============================================================================
+// VALUE REPRESENTATION
+// ============================================================================
+
+// On 64-bit targets a Sexp* is a tagged word rather than always a pointer:
+//
+//   0x2                 nil
+//   0x6                 the symbol T
+//   below 2^48, odd     tagged pointer to a ConsCell
+//   below 2^48, even    pointer to a heap Sexp
+//   2^48 .. 2^49        a fixnum: 48-bit two's complement integer plus 2^48
+//   2^49 and above      a number: the double's bits plus 2^49 (NaN-boxed)
+//
+// Doubles, fixnums, nil and T never touch the heap; integers outside the
+// fixnum range are boxed in an ATOM_INTEGER cell. Always go through
+// sexp_type(), sexp_number(), sexp_integer(), symbol_name() and sexp_cons()
+// rather than dereferencing a value that may be immediate or a cons. Build
+// with -DLISP_BOXED_VALUES, or on a 32-bit target, to keep numbers, nil and
+// T heap cells.
+
+#if !defined(LISP_BOXED_VALUES) && UINTPTR_MAX == 0xFFFFFFFFFFFFFFFFu
+#define LISP_NAN_BOXING 1
+#endif
+
+#ifdef LISP_NAN_BOXING
+
+#define SEXP_NIL_BITS       ((uintptr_t)0x2)
+#define SEXP_TRUE_BITS      ((uintptr_t)0x6)
+#define SEXP_POINTER_LIMIT  ((uintptr_t)1 << 48)
+#define SEXP_DOUBLE_OFFSET  ((uintptr_t)1 << 49)
+#define SEXP_FIXNUM_MIN     (-((int64_t)1 << 47))
+#define SEXP_FIXNUM_MAX     (((int64_t)1 << 47) - 1)
+
+// True for any heap reference, cons or not. One unsigned compare covers
+// both ends of the pointer range.
+static inline bool sexp_is_heap(const Sexp* s) {
+    return (uintptr_t)s - (SEXP_TRUE_BITS + 1) < SEXP_POINTER_LIMIT - (SEXP_TRUE_BITS + 1);
+}
+
+static inline bool sexp_is_cons(const Sexp* s) {
+    return ((uintptr_t)s & SEXP_CONS_TAG) && (uintptr_t)s < SEXP_POINTER_LIMIT;
+}
+
+// True if s points at a full Sexp (not a cons)
+static inline bool sexp_is_pointer(const Sexp* s) {
+    return sexp_is_heap(s) && !((uintptr_t)s & SEXP_CONS_TAG);
+}
+
+static inline bool sexp_is_nil(const Sexp* s) {
+    return (uintptr_t)s == SEXP_NIL_BITS;
+}
+
+static inline SexpType sexp_type(const Sexp* s) {
+    uintptr_t bits = (uintptr_t)s;
+    if (sexp_is_heap(s)) return (bits & SEXP_CONS_TAG) ? CONS_CELL : s->type;
+    if (bits >= SEXP_DOUBLE_OFFSET) return ATOM_NUMBER;
+    if (bits >= SEXP_POINTER_LIMIT) return ATOM_INTEGER;
+    return bits == SEXP_NIL_BITS ? NIL_TYPE : ATOM_SYMBOL;
+}
+
+static inline bool sexp_is_fixnum(const Sexp* s) {
+    return (uintptr_t)s - SEXP_POINTER_LIMIT < SEXP_POINTER_LIMIT;
+}
+
+// Only for values in [SEXP_FIXNUM_MIN, SEXP_FIXNUM_MAX]; see make_integer()
+static inline Sexp* sexp_box_fixnum(int64_t value) {
+    return (Sexp*)(SEXP_POINTER_LIMIT + ((uintptr_t)value & (SEXP_POINTER_LIMIT - 1)));
+}
+
+static inline int64_t sexp_integer(const Sexp* s) {
+    if (!sexp_is_fixnum(s)) return s->data.integer;
+    // Shift the 48-bit payload to the top and back to sign-extend it
+    return (int64_t)(((uint64_t)(uintptr_t)s - SEXP_POINTER_LIMIT) << 16) >> 16;
+}
+
+static inline double sexp_number(const Sexp* s) {
+    uint64_t bits = (uint64_t)(uintptr_t)s - SEXP_DOUBLE_OFFSET;
+    double value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static inline Sexp* sexp_box_number(double value) {
+    uint64_t bits;
+    if (value != value) value = __builtin_nan("");  // One canonical NaN
+    memcpy(&bits, &value, sizeof(bits));
+    return (Sexp*)(uintptr_t)(bits + SEXP_DOUBLE_OFFSET);
+}
+
+static inline const char* symbol_name(const Sexp* s) {
+    return (uintptr_t)s == SEXP_TRUE_BITS ? "T" : s->data.symbol;
+}
+
+static inline SpecialForm symbol_form(const Sexp* s) {
+    return (uintptr_t)s == SEXP_TRUE_BITS ? FORM_NONE : (SpecialForm)s->form;
+}
+
+#else
+
+static inline bool sexp_is_heap(const Sexp* s) {
+    return s != NULL;
+}
+
+static inline bool sexp_is_cons(const Sexp* s) {
+    return ((uintptr_t)s & SEXP_CONS_TAG) != 0;
+}
+
+static inline bool sexp_is_pointer(const Sexp* s) {
+    return s && !((uintptr_t)s & SEXP_CONS_TAG);
+}
+
+static inline bool sexp_is_nil(const Sexp* s) {
+    return sexp_is_pointer(s) && s->type == NIL_TYPE;
+}
+
+static inline SexpType sexp_type(const Sexp* s) {
+    return ((uintptr_t)s & SEXP_CONS_TAG) ? CONS_CELL : s->type;
+}
+
+static inline double sexp_number(const Sexp* s) {
+    return s->data.number;
+}
+
+static inline bool sexp_is_fixnum(const Sexp* s) {
+    (void)s;
+    return false;
+}
+
+static inline int64_t sexp_integer(const Sexp* s) {
+    return s->data.integer;
+}
+
+static inline const char* symbol_name(const Sexp* s) {
+    return s->data.symbol;
+}
+
+static inline SpecialForm symbol_form(const Sexp* s) {
+    return (SpecialForm)s->form;
+}
+
+#endif
+
+static inline ConsCell* sexp_cons(const Sexp* s) {
+    return (ConsCell*)((uintptr_t)s - SEXP_CONS_TAG);
+}
+
+// The value of any number (ATOM_NUMBER or ATOM_INTEGER) as a double
+static inline double sexp_as_double(const Sexp* s) {
+    return sexp_type(s) == ATOM_INTEGER ? (double)sexp_integer(s) : sexp_number(s);
+}
+
+// ============================================================================
+// INTERPRETER CONTEXTS
+// ============================================================================
+
+// An Interp owns a heap, symbol table, global environment, engine state and
+// settings. Each thread runs on one current Interp, to begin with a default
+// one, and every function below that takes no Interp acts on the current
+// one. Values belong to the Interp that made them; an Interp may be used by
+// one thread at a time, so N interpreters can run on N cores.
+typedef struct Interp Interp;
+
+Interp* interp_new(void);           // Empty; settings from the current one
+void interp_free(Interp* ctx);      // Releases its heap; not while current
+Interp* interp_enter(Interp* ctx);  // Make current; returns the previous one
+Interp* interp_current(void);
+
+// The same as init_global_env/parse/evaluate inside ctx, restoring the
+// caller's current Interp afterwards
+void interp_init_global_env(Interp* ctx);
+Sexp* interp_parse(Interp* ctx, const char* input);
+Sexp* interp_evaluate(Interp* ctx, Sexp* sexp);   // In ctx's global env
+
+Sexp* global_env(void);     // The current Interp's global environment
+
+#define NIL        (nil())
+#define TRUE_SEXP  (true_sexp())
+#define GLOBAL_ENV (global_env())
+
+// ============================================================================
+// MEMORY MANAGEMENT
+// ============================================================================
+
+Sexp* allocate_sexp(void);
+
+// Garbage collector. Sexp cells live in 64KB slab pages; a collection marks
+// everything reachable from the global env, symbols, registered roots and
+// the C stack, then sweeps the rest onto free lists or releases whole pages.
+// A form that needs more than max_cells after a collection returns
+// ERROR:OUT_OF_MEMORY, and the heap is back under the limit once it has.
+#define GC_DEFAULT_HEAP_CELLS 65536
+#define GC_DEFAULT_MAX_CELLS  0          // 0 = no limit
+
+void gc_configure(size_t initial_cells, size_t max_cells);
+void gc_register_root(Sexp** root);
+void gc_collect(void);
+size_t gc_live_cells(void);
+size_t gc_heap_cells(void);
+
+// Scratch arena: bump-allocated buffers released together back to a mark
+typedef struct {
+    struct ArenaChunk* chunk;
+    size_t used;
+} ScratchMark;
+
+void* scratch_alloc(size_t size);
+ScratchMark scratch_mark(void);
+void scratch_release(ScratchMark mark);
+void heap_reset_scratch(void);
+
+// ============================================================================
+// CONSTRUCTORS
+// ============================================================================
+
+Sexp* nil(void);
+Sexp* true_sexp(void);      // The shared T symbol (TRUE_SEXP)
+Sexp* make_number(double value);
+Sexp* make_integer(int64_t value);
+Sexp* make_symbol(const char* value);   // Same as intern()
+Sexp* intern(const char* name);
+Sexp* make_string(const char* value);
+Sexp* cons(Sexp* car, Sexp* cdr);
+Sexp* make_lambda(Sexp* params, Sexp* body, Sexp* env);
+Sexp* make_closure(Sexp* proto, Sexp* env);
+Sexp* make_proto(Sexp* params, Sexp* body, Sexp* env);
+Sexp* make_primitive(PrimitiveFunc func);    // Any number of arguments
+Sexp* make_primitive_arity(PrimitiveFunc func, int min_args, int max_args);
+
+// ============================================================================
+// PREDICATES
+// ============================================================================
+
+bool isNil(Sexp* s);
+bool isNumber(Sexp* s);     // Integer or double
+bool isInteger(Sexp* s);
+bool isSymbol(Sexp* s);
+bool isString(Sexp* s);
+bool isList(Sexp* s);
+bool isTrueSexp(Sexp* s);
+bool isLambda(Sexp* s);
+bool isPrimitive(Sexp* s);
+
+// ============================================================================
+// ACCESSORS
+// ============================================================================
+
+Sexp* car(Sexp* s);
+Sexp* cdr(Sexp* s);
+Sexp* cadr(Sexp* s);
+Sexp* caddr(Sexp* s);
+Sexp* cadddr(Sexp* s);
+Sexp* cddr(Sexp* s);
+Sexp* cdddr(Sexp* s);
+
+// ============================================================================
+// ADDITIONAL FUNCTIONS
+// ============================================================================
+
+bool eq(Sexp* a, Sexp* b);
+bool null(Sexp* s);
+
+// ============================================================================
+// ARITHMETIC FUNCTIONS
+// ============================================================================
+
+Sexp* add(Sexp* a, Sexp* b);
+Sexp* sub(Sexp* a, Sexp* b);
+Sexp* mul(Sexp* a, Sexp* b);
+Sexp* divide(Sexp* a, Sexp* b);
+Sexp* mod(Sexp* a, Sexp* b);
+
+// ============================================================================
+// COMPARISON FUNCTIONS
+// ============================================================================
+
+Sexp* lt(Sexp* a, Sexp* b);
+Sexp* gt(Sexp* a, Sexp* b);
+Sexp* lte(Sexp* a, Sexp* b);
+Sexp* gte(Sexp* a, Sexp* b);
+Sexp* not(Sexp* s);
+
+// ============================================================================
+// ENVIRONMENT FUNCTIONS
+// ============================================================================
+
+Sexp* make_env(Sexp* symbols, Sexp* values, Sexp* parent);
+Sexp* make_table_env(Sexp* parent);
+Sexp* env_symbols(Sexp* env);
+Sexp* env_values(Sexp* env);
+Sexp* env_parent(Sexp* env);
+Sexp* env_set(Sexp* env, Sexp* symbol, Sexp* value);
+Sexp* env_lookup(Sexp* env, Sexp* symbol);
+void init_global_env(void);
+
+// ============================================================================
+// EVAL FUNCTION
+// ============================================================================
+
+// eval keeps its continuation on a growable heap stack, and the VM its
+// call records, so deep non-tail recursion doesn't use the C stack. Past
+// max_depth frames (0 = no limit) the whole evaluation stops and returns
+// ERROR:STACK_OVERFLOW. The reader uses the same limit for nesting depth.
+#define EVAL_DEFAULT_MAX_DEPTH (1 << 22)
+
+void eval_configure(size_t max_depth);
+Sexp* eval(Sexp* sexp, Sexp* env);
+Sexp* eval_list(Sexp* list, Sexp* env);
+Sexp* apply(Sexp* func, Sexp* args, Sexp* env);
+Sexp* apply_argv(Sexp* func, int argc, Sexp** argv, Sexp* env);
+
+// ============================================================================
+// BYTECODE VM
+// ============================================================================
+
+// Three engines run the same closures and frames: eval walks the
+// S-expression tree, the VM compiles each lambda body to bytecode on first
+// call, and the closure compiler turns it into a tree of nodes that each
+// hold the C function running them.
+typedef enum {
+    ENGINE_EVAL,
+    ENGINE_VM,
+    ENGINE_NODES
+} Engine;
+
+void set_engine(Engine engine);
+Engine get_engine(void);
+Sexp* vm_eval(Sexp* sexp, Sexp* env);
+Sexp* node_eval(Sexp* sexp, Sexp* env);
+Sexp* evaluate(Sexp* sexp, Sexp* env);  // eval, vm_eval or node_eval, per set_engine()
+
+// Under every engine, a lambda called more than threshold times whose body
+// is arithmetic, comparisons, if/cond and calls to itself gets native
+// x86-64 code for the argument types it is called with. 0 turns the JIT
+// off; on other targets it is always off.
+#define JIT_DEFAULT_THRESHOLD 0
+
+void jit_configure(size_t threshold);
+
+// ============================================================================
+// LIST LIBRARY
+// ============================================================================
+
+Sexp* reverse(Sexp* list);
+Sexp* nth(int64_t n, Sexp* list);
+Sexp* assoc(Sexp* key, Sexp* alist);
+Sexp* member(Sexp* x, Sexp* list);
+Sexp* map_list(Sexp* func, Sexp* list, Sexp* env);
+Sexp* filter_list(Sexp* func, Sexp* list, Sexp* env);
+Sexp* fold_list(Sexp* func, Sexp* init, Sexp* list, Sexp* env);
+
+// ============================================================================
+// PARALLEL EVALUATION
+// ============================================================================
+
+// (pmap f list) and (future expr)/(touch f) run on a pool of worker
+// threads, each with an Interp of its own, that steal work from each
+// other. The calling thread works too, so threads = 0 starts one worker
+// per core but one; 1 runs everything on the caller. Takes effect if
+// called before the first pmap or future. Workers get copies of the
+// function, its arguments and the globals, so a set or define inside a
+// pmap'd function or future body doesn't reach the caller.
+#define POOL_DEFAULT_THREADS 0
+
+void pool_configure(size_t threads);
+void pool_shutdown(void);   // Join the workers; also runs at exit
+Sexp* pmap_list(Sexp* func, Sexp* list, Sexp* env);
+
+// ============================================================================
+// HELPER FUNCTIONS
+// ============================================================================
+
+Sexp* atom(const char* str);
+Sexp* list(void);
+Sexp* list1(Sexp* a);
+Sexp* list2(Sexp* a, Sexp* b);
+Sexp* list3(Sexp* a, Sexp* b, Sexp* c);
+Sexp* list4(Sexp* a, Sexp* b, Sexp* c, Sexp* d);
+Sexp* append(Sexp* list1, Sexp* list2);
+int length(Sexp* list);
+
+// ============================================================================
+// PRINTING FUNCTIONS
+// ============================================================================
+
+void print_sexp(Sexp* s);
+void println_sexp(Sexp* s);
+
+// ============================================================================
+// PARSER FUNCTIONS
+// ============================================================================
+
+Sexp* parse(const char* input);
+Sexp* read_sexp(const char** input);
+
 #endif // LISP_INTERPRETER_H
\ No newline at end of file
@@ -0,0 +1,63 @@
+// Interpreter contexts (see INTERPRETER CONTEXTS): each Interp has its own
+// globals and heap, and entering one leaves the others untouched, whether
+// it is entered on this thread or on four others at once.
+
+#include <stdio.h>
+#include <pthread.h>
+#include "lisp_interpreter.h"
+
+static void print_line(Sexp* sexp) {
+    print_sexp(sexp);
+    printf("\n");
+}
+
+static void* run(void* arg) {
+    Interp* ctx = interp_new();
+    Interp* prev = interp_enter(ctx);
+    init_global_env();
+    evaluate(parse("(define fib (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))"), GLOBAL_ENV);
+    evaluate(parse("(gc)"), GLOBAL_ENV);
+    Sexp* result = evaluate(parse("(fib 18)"), GLOBAL_ENV);
+    *(int64_t*)arg = isNumber(result) ? (int64_t)sexp_as_double(result) : -1;
+    interp_enter(prev);
+    interp_free(ctx);
+    return NULL;
+}
+
+int main(void) {
+    nil();
+    init_global_env();
+    evaluate(parse("(set l '(1 2 3))"), GLOBAL_ENV);
+    evaluate(parse("(define fib (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))"), GLOBAL_ENV);
+
+    int64_t results[4];
+    pthread_t threads[4];
+    for (int i = 0; i < 4; i++) pthread_create(&threads[i], NULL, run, &results[i]);
+    for (int i = 0; i < 4; i++) pthread_join(threads[i], NULL);
+    for (int i = 0; i < 4; i++) printf("%lld\n", (long long)results[i]);
+
+    // The threads' contexts are gone; this one must be untouched
+    evaluate(parse("(gc)"), GLOBAL_ENV);
+    print_line(evaluate(parse("l"), GLOBAL_ENV));
+
+    // A second context entered on this thread, then left again
+    Interp* other = interp_new();
+    Interp* prev = interp_enter(other);
+    init_global_env();
+    print_line(evaluate(parse("fib"), GLOBAL_ENV));
+    print_line(evaluate(parse("(begin (set l '(a b)) (gc) l)"), GLOBAL_ENV));
+    interp_enter(prev);
+
+    evaluate(parse("(gc)"), GLOBAL_ENV);
+    print_line(evaluate(parse("l"), GLOBAL_ENV));
+    print_line(evaluate(parse("(fib 18)"), GLOBAL_ENV));
+
+    // Back into the second one: its bindings survived the switch
+    interp_enter(other);
+    print_line(evaluate(parse("l"), GLOBAL_ENV));
+    interp_enter(prev);
+    interp_free(other);
+    evaluate(parse("(gc)"), GLOBAL_ENV);
+    print_line(evaluate(parse("l"), GLOBAL_ENV));
+    return 0;
+}
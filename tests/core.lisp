@@ -0,0 +1,96 @@
+(+ 1 2)
+(- 10 4)
+(* 6 7)
+(+ 1 2 3)
+(- 10 4 3)
+(- 5)
+(* 2 3 4)
+(+)
+(< 1 2 3)
+(< 1 3 2)
+(>= 3 3 2)
+(max 3 7 2)
+(min 3 7 2)
+(max 1 2.5)
+(min 1 2.5)
+(car)
+(% 1 2 3)
+(cons 1)
+(/ 20 4)
+(/ 10 4)
+(% 17 5)
+(/ 5 0)
+(% 5 0)
+(+ 1 'a)
+(not ())
+(not 5)
+(eq 'a 'a)
+(eq 'a 'b)
+(eq 3 3)
+(car '(1 2 3))
+(cdr '(1 2 3))
+(car 5)
+(cons 1 2)
+(cons 1 '(2 3))
+'(a b . c)
+'((a b) (c (d e)) . f)
+"a string"
+(quote sym)
+(set x 5)
+x
+(if (< x 10) 'small 'big)
+(if () 'yes)
+(and (> 5 3) (< 2 4))
+(and 1 () (/ 1 0))
+(or () 3)
+(or 1 (/ 1 0))
+(cond ((< 5 3) 'first) ((> 5 3) 'second) (T 'third))
+(cond ((< 5 3) 'first))
+(define square (x) (* x x))
+(square 7)
+(define add3 (a b c) (+ a (+ b c)))
+(add3 1 2 3)
+(define fact (n) (if (<= n 1) 1 (* n (fact (- n 1)))))
+(fact 5)
+(fact 20)
+(define fib (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))
+(fib 20)
+((lambda (x) (* x 2)) 5)
+((lambda (a b) (- a b)) 10 3)
+(set double (lambda (x) (* 2 x)))
+(double 21)
+(define make-adder (n) (lambda (x) (+ x n)))
+((make-adder 5) 10)
+(set add10 (make-adder 10))
+(add10 1)
+(define compose (f g) (lambda (x) (f (g x))))
+((compose double add10) 1)
+(undefined-fn 3)
+undefined-symbol
+(5 1)
+(define pick (a b c d e f) (cons a (cons f ())))
+(pick 1 2 3 4 5 6)
+(pick (car (pick 7 2 3 4 5 6)) 2 3 4 5 (fact 5))
+((lambda (a b c d) (- (+ a b) (+ c d))) (square 3) (fact 3) (pick 1 2 3 4 5 6) 2)
+(define mk (n acc) (if (eq n 0) acc (mk (- n 1) (cons n acc))))
+(car (cdr (cdr (mk 2000 ()))))
+(car (mk 2000 (mk 2000 ())))
+(cons (cons 1 2) (cons '(a . b) ()))
+(define twice (x) (* 2 x))
+(define use (x) (twice x))
+(use 5)
+(define twice (x) (* 3 x))
+(use 5)
+(set twice 7)
+(use 5)
+(define later (x) (not-yet x))
+(later 1)
+(define not-yet (x) (+ x 100))
+(later 1)
+(define addit (a b) (+ a b))
+(addit 5 3)
+(set plus +)
+(set + -)
+(addit 5 3)
+(set + plus)
+(addit 5 3)
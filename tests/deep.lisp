@@ -0,0 +1,19 @@
+(define deep (n) (if (eq n 0) 0 (+ 1 (deep (- n 1)))))
+(deep 100000)
+(define build (n) (if (eq n 0) '() (cons n (build (- n 1)))))
+(length (build 100000))
+(define deepl (n) (if (eq n 0) 0 (let ((r (deepl (- n 1)))) (+ r 1))))
+(deepl 50000)
+(define loop (n acc) (if (eq n 0) acc (loop (- n 1) (+ acc 1))))
+(loop 1000000 0)
+(define ev (n) (if (eq n 0) 'T (od (- n 1))))
+(define od (n) (if (eq n 0) () (ev (- n 1))))
+(ev 100001)
+(define cloop (n) (cond ((eq n 0) 'done) (T (cloop (- n 1)))))
+(cloop 300000)
+(define aloop (n) (and T (or () (if (eq n 0) 'done (aloop (- n 1))))))
+(aloop 300000)
+(define make (n) (lambda (x) (+ x n)))
+(define many (n acc) (if (eq n 0) acc (many (- n 1) ((make n) acc))))
+(many 100000 0)
+(+ 1 1)
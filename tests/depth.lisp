@@ -0,0 +1,12 @@
+(define build (n) (if (eq n 0) () (cons n (build (- n 1)))))
+(build 5000)
+(length (build 300))
+(define count (n) (if (eq n 0) 0 (let ((r (count (- n 1)))) (+ r 1))))
+(count 5000)
+(build 5000)
+(+ 1 1)
+(define deep (n) (if (eq n 0) 0 (+ 1 (deep (- n 1)))))
+(deep 5000)
+(deep 900)
+(deep 5000)
+(deep 20)
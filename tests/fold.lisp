@@ -0,0 +1,47 @@
+(define secs (d) (* d (* 60 60 24)))
+(expand secs)
+(secs 2)
+(define k3 () (+ 1 2))
+(define g (x) (* x (* 60 60)))
+(define h (x) (if (< 1 2) x 0))
+(define c (x) (cond ((< 2 1) 'a) ((> 2 1) x) (T 'z)))
+(define n (x) (+ x (* 2 (+ 1 2))))
+(define inl (x) ((lambda (a) (+ a 1)) (* 2 3)))
+(define lt (x) (let ((y (* 2 3))) (+ x y)))
+(define err () (/ 1 0))
+(expand g)
+(expand h)
+(expand c)
+(expand inl)
+(k3)
+(g 1)
+(h 7)
+(c 5)
+(n 1)
+(inl 0)
+(lt 1)
+(err)
+(k3)
+(g 2)
+(h 3)
+(n 4)
+(set + -)
+(set * +)
+(set < >)
+(k3)
+(g 1)
+(h 7)
+(c 5)
+(n 1)
+(inl 0)
+(lt 1)
+(expand k3)
+(expand g)
+(expand h)
+(k3)
+(g 1)
+(h 7)
+(define badcar () (car 5))
+(expand badcar)
+(define okcar () (cdr (car '((1 2) 3))))
+(expand okcar)
@@ -0,0 +1,48 @@
+(begin 1 2 3)
+(begin)
+(define f (x) (set y (* x 2)) (+ y 1))
+(f 5)
+y
+((lambda (a b) (set c (+ a b)) (* c c)) 1 2)
+(let ((a 1) (b 2)) (+ a b))
+(let ((a 1) (b 2)) (set a 10) (+ a b))
+(let* ((a 1) (b (+ a 1)) (a (* b 10))) (cons a b))
+(letrec ((ev (lambda (n) (if (eq n 0) 'T (od (- n 1))))) (od (lambda (n) (if (eq n 0) () (ev (- n 1)))))) (ev 1001))
+(define sum-to (n) (let ((i 0) (acc 0)) (while (< i n) (set acc (+ acc i)) (set i (+ i 1))) acc))
+(sum-to 10000)
+(define sum2 (n) (do ((i 0 (+ i 1)) (acc 0 (+ acc i))) ((eq i n) acc)))
+(sum2 10000)
+(define fibi (n) (do ((i 0 (+ i 1)) (a 0 b) (b 1 (+ a b))) ((eq i n) a)))
+(fibi 50)
+(do ((i 0 (+ i 1))) ((eq i 3) 'done))
+(set g 0)
+(while (< g 1000) (set g (+ g 1)))
+g
+((let ((x 5)) (let ((y 6)) (lambda (z) (+ x y z)))) 1)
+(define adders (n) (let ((k n)) (lambda (x) (+ x k))))
+((adders 7) 3)
+(define shadow (x) (let ((x (+ x 1))) (let* ((x (* x 2))) x)))
+(shadow 3)
+(let () 7)
+(define cnt (n) (let ((c 0)) (do ((i 0 (+ i 1))) ((eq i n) c) (set c (+ c 2)))))
+(cnt 10)
+(define nest (n) (let ((t 0)) (do ((i 0 (+ i 1))) ((eq i n) t) (do ((j 0 (+ j 1))) ((eq j n)) (set t (+ t 1))))))
+(nest 30)
+(define keep (n) (let ((fs '())) (do ((i 0 (+ i 1))) ((eq i n) (map (lambda (f) (f)) fs)) (let ((j i)) (set fs (cons (lambda () j) fs))))))
+(keep 4)
+(define deepl (n) (if (eq n 0) 0 (let ((r (deepl (- n 1)))) (+ r 1))))
+(deepl 2000)
+(define pair (a b) (lambda (x) (cons a (cons b (cons x ())))))
+(set p1 (pair 1 2))
+(define clobber (a b c d) (+ a b c d))
+(clobber 10 20 30 40)
+(p1 3)
+(define inner (n) (let ((k (* n 10))) (lambda () (+ k n))))
+(set fs (map inner '(1 2 3)))
+(clobber 5 6 7 8)
+(map (lambda (f) (f)) fs)
+(define noescape (n) (let ((a n) (b (* n 2))) (+ a b)))
+(noescape 4)
+(define maybe (n) (if (< n 0) (lambda () n) n))
+(maybe 5)
+((maybe -5))
@@ -0,0 +1,12 @@
+(define build (n) (if (eq n 0) () (cons n (build (- n 1)))))
+(length (build 1000))
+(length (build 10000))
+(length (build 1000))
+(define grow (acc) (grow (cons 1 acc)))
+(grow ())
+(set x ())
+(while T (set x (cons 1 x)))
+(set x ())
+(define mk (n acc) (if (eq n 0) acc (mk (- n 1) (cons n acc))))
+(length (mk 1000 ()))
+(+ 1 2)
@@ -0,0 +1,61 @@
+(define fib (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))
+(fib 20)
+(fib 20.0)
+(define loop (i acc) (if (eq i 0) acc (loop (- i 1) (+ acc i))))
+(loop 10000 0)
+(loop 10000.0 0.5)
+(define sq (x) (* x x))
+(sq 3)
+(sq 3)
+(sq 3)
+(sq 3000000000)
+(sq 4000000000000)
+(sq 2.5)
+(define dv (a b) (/ a b))
+(dv 10 2)
+(dv 10 2)
+(dv 10 2)
+(dv 10 4)
+(dv 10 0)
+(dv -9223372036854775807 -1)
+(dv 1.0 0.0)
+(dv 1.0 4.0)
+(define md (a b) (% a b))
+(md 17 5)
+(md 17 5)
+(md 17 5)
+(md -17 5)
+(md 17 -1)
+(md 17 0)
+(define sgn (x) (cond ((< x 0) -1) ((> x 0) 1) ((eq x 0) 0)))
+(sgn -5)
+(sgn 7)
+(sgn 0)
+(sgn -2.5)
+(define neg (x) (- x))
+(neg 5)
+(neg 5)
+(neg 5)
+(neg 0.0)
+(neg 2.5)
+(define both (a b) (if (and (> a 0) (not (< b 0))) (+ a b) (or 0 1)))
+(both 1 2)
+(both 1 2)
+(both 1 2)
+(both -1 2)
+(define mix (x) (+ x 0.5))
+(mix 1)
+(mix 1)
+(mix 1)
+(mix 1.5)
+(mix 'a)
+(define count (n) (if (eq n 0) 0 (+ 1 (count (- n 1)))))
+(count 100000)
+(define ack (m n) (cond ((eq m 0) (+ n 1)) ((eq n 0) (ack (- m 1) 1)) (T (ack (- m 1) (ack m (- n 1))))))
+(ack 2 3)
+(set + -)
+(fib 10)
+(sq 3)
+(loop 10 0)
+(set fib 5)
+fib
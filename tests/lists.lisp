@@ -0,0 +1,32 @@
+(length '(1 2 3))
+(length '())
+(length 5)
+(reverse '(1 2 3))
+(append '(1) '(2 3) '(4))
+(append)
+(append '(1 2) 3)
+(nth 0 '(a b c))
+(nth 2 '(a b c))
+(nth 5 '(a b c))
+(nth -1 '(1 2))
+(assoc 'b '((a 1) (b 2)))
+(assoc 'z '((a 1) (b 2)))
+(member 3 '(1 2 3 4))
+(member 9 '(1 2 3 4))
+(map (lambda (x) (* x x)) '(1 2 3 4))
+(map car '((1 2) (3 4)))
+(filter (lambda (x) (> x 1)) '(1 2 3))
+(fold + 0 '(1 2 3 4 5))
+(fold (lambda (acc x) (cons x acc)) '() '(1 2 3))
+(reduce + '(1 2 3 4))
+(reduce max '(3 9 2))
+(map 5 '(1 2))
+(define rng (n) (if (eq n 0) '() (cons n (rng (- n 1)))))
+(length (rng 1000))
+(fold + 0 (map (lambda (x) (* 2 x)) (filter (lambda (x) (eq (% x 2) 0)) (rng 100))))
+(define loop (n acc) (if (eq n 0) acc (loop (- n 1) (cons n acc))))
+(length (loop 2000 ()))
+(nth 1999 (loop 2000 ()))
+(length (reverse (loop 2000 ())))
+(define mdeep (n) (if (eq n 0) 0 (car (map (lambda (x) (+ 1 (mdeep (- n 1)))) '(1)))))
+(mdeep 100)
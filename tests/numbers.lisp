@@ -0,0 +1,51 @@
+(+ 1 2.5)
+(+ 0.5 0.25)
+(* 1.5 2)
+(/ 10 3)
+(/ 1.0 4)
+(/ 1.0 0.0)
+(% 7.5 2)
+(- 0.0 0.0)
+(- 0 1e-300)
+1e300
+(* 1e300 1e10)
+(- 0 (* 1e300 1e10))
+4503599627370496
+-4503599627370496
+(* 4503599627370496 4)
+(< 1 1.5)
+(< 2 1.5)
+(eq 0.1 0.1)
+(eq 1 1.0)
+(eq () ())
+(eq 'T (< 1 2))
+(cons 1.5 (cons () (cons 'T ())))
+(car (cons 1e300 2))
+(define sum (n acc) (if (eq n 0) acc (sum (- n 1) (+ acc n))))
+(sum 100000 0)
+(sum 100000 0.5)
+(/ 9 3)
+(/ -9 3)
+(% 17 5)
+(% -17 5)
+(% 17 -5)
+(* 4611686018427387904 2)
+(+ 9223372036854775807 1)
+(- -9223372036854775807 2)
+(* 3037000500 3037000500)
+(/ -9223372036854775807 -1)
+9223372036854775807
+-9223372036854775807
+140737488355327
+140737488355328
+-140737488355328
+-140737488355329
+(+ 140737488355327 1)
+(- -140737488355328 1)
+(* 140737488355328 2)
+(eq 140737488355328 140737488355328)
+(eq (+ 140737488355327 1) 140737488355328)
+(define fact (n) (if (<= n 1) 1 (* n (fact (- n 1)))))
+(fact 20)
+(fact 21)
+(fact 25)
@@ -0,0 +1,30 @@
+(define sq (x) (* x x))
+(pmap sq '(1 2 3 4 5 6 7 8 9 10))
+(pmap (lambda (x) (* x 2.5)) '(1 2 3))
+(define fib (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))
+(pmap fib '(15 16 17 18 10 11))
+(let ((k 7)) (pmap (lambda (x) (+ x k)) '(1 2 3 4)))
+(set big 1000)
+(pmap (lambda (x) (cons x (cons big (cons "s" (cons 'sym ()))))) '(1 2 3))
+(letrec ((f (lambda (n) (if (eq n 0) 1 (* n (f (- n 1))))))) (pmap f '(5 6 7 8)))
+(pmap car '((1 2) (3 4) (5 6)))
+(pmap (lambda (l) (pmap sq l)) '((1 2 3) (4 5 6) (7 8 9)))
+(define mk (n) (lambda (x) (* x n)))
+(pmap (mk 3) '(1 2 3))
+(set f1 (future (fib 18)))
+(touch f1)
+(touch f1)
+(touch (future (pmap fib '(10 11 12))))
+(pmap (lambda (x) (touch (future (+ x 1)))) '(1 2 3 4 5))
+(set fs (map (lambda (x) (future (fib x))) '(12 13 14 15)))
+(map touch fs)
+(pmap sq '())
+(pmap sq '(3))
+(pmap 5 '(1 2))
+(pmap (lambda (x) (/ x 0)) '(1 2))
+(touch 3)
+(pmap (lambda (x) (set big x)) '(1 2 3))
+big
+(define rng (n) (if (eq n 0) '() (cons n (rng (- n 1)))))
+(fold + 0 (pmap (lambda (x) (fib (% x 12))) (rng 40)))
+(fold + 0 (pmap (lambda (x) (fold + 0 (pmap (lambda (y) (* x y)) '(1 2 3)))) (rng 40)))
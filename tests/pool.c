@@ -0,0 +1,31 @@
+// Thread pool lifetime (see PARALLEL EVALUATION): futures started before
+// pool_shutdown() still finish, shutting down twice is harmless, and the
+// next pmap or future starts the pool again.
+
+#include <stdio.h>
+#include "lisp_interpreter.h"
+
+static void run(const char* source) {
+    print_sexp(evaluate(parse(source), GLOBAL_ENV));
+    printf("\n");
+}
+
+int main(void) {
+    pool_configure(4);
+    nil();
+    init_global_env();
+    run("(define fib (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2)))))");
+    run("(pmap fib '(15 16 17 18 19 20))");
+    run("(set f (future (fib 20)))");
+    run("(set g (future (fib 21)))");
+    pool_shutdown();
+    run("(touch f)");
+    run("(touch g)");
+    run("(pmap fib '(10 11 12 13))");
+    run("(set h (future (fib 19)))");
+    pool_shutdown();
+    pool_shutdown();
+    run("(touch h)");
+    run("(pmap (lambda (x) (* x x)) '(1 2 3 4 5 6 7 8 9 10))");
+    return 0;
+}